@@ -0,0 +1,278 @@
+#include "Ant.h"
+#include "Simulation.h"
+
+#include <algorithm>
+#include <atomic>
+#include <barrier>
+#include <cstddef>
+#include <cstdlib>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+namespace {
+	inline size_t margin(const Ant &ant, size_t length) { return ::margin(ant.x, ant.y, length); }
+
+	/** Epochs are at most this many rounds, so groups are re-formed often enough to follow the ants. */
+	constexpr size_t MAX_EPOCH = size_t(1) << 16;
+	/** Shorter epochs would spend more time forming groups and starting threads than stepping ants. While an ant is closer
+	 *  to an edge, the ants take this many rounds sequentially, growing the grid only as much as stepping them would. */
+	constexpr size_t MIN_EPOCH = size_t(1) << 10;
+
+	/** Returns the representative of an ant's group, flattening the path to it. */
+	size_t findGroup(std::vector<size_t> &parents, size_t ant) {
+		while (parents[ant] != ant)
+			ant = parents[ant] = parents[parents[ant]];
+		return ant;
+	}
+
+	/** Runs rounds through the grid's bounds checks, or undoes them if BACKWARD. If an ant's step expands the grid, the
+	 *  others are moved too. */
+	template <bool BACKWARD>
+	void runChecked(Grid<uint8_t, Coord> &grid, std::span<Ant> ants, size_t count) {
+		for (size_t i = 0; i < count; ++i) {
+			for (size_t j = 0; j < ants.size(); ++j) {
+				Ant &ant = ants[BACKWARD? ants.size() - 1 - j : j];
+				if (BACKWARD)
+					applyOffset((ant.direction + 2) & 3, ant.x, ant.y);
+				const size_t length = grid.getLength();
+				auto &color = grid(ant.x, ant.y);
+				if (grid.getLength() != length) {
+					const Coord shift = grid.getOrigin() - Grid<uint8_t, Coord>::getOrigin(length);
+					for (Ant &other: ants) {
+						if (&other != &ant) {
+							other.x += shift;
+							other.y += shift;
+						}
+					}
+				}
+				if (BACKWARD) {
+					ant.direction = (ant.direction - ant.rule.getUndoTurn(color)) & 3;
+					color = ant.rule.getPreviousColor(color);
+				} else {
+					ant.direction = (ant.direction + ant.rule.getTurn(color)) & 3;
+					color = ant.rule.getNextColor(color);
+					applyOffset(ant.direction, ant.x, ant.y);
+				}
+			}
+		}
+	}
+
+	/** The body of simulate() and reverse(). Going backward, rounds and the ants within them are undone in the opposite
+	 *  order. */
+	template <bool BACKWARD>
+	void run(Grid<uint8_t, Coord> &grid, std::span<Ant> ants, size_t count) {
+		std::vector<uint8_t *> cells(ants.size());
+		std::vector<uint8_t> directions(ants.size());
+
+		while (count != 0) {
+			const size_t length = grid.getLength();
+			size_t chunk = count;
+			for (const Ant &ant: ants)
+				chunk = std::min(chunk, margin(ant, length));
+
+			if (chunk < NEAR_EDGE) {
+				const size_t checked = std::min(count, NEAR_EDGE);
+				runChecked<BACKWARD>(grid, ants, checked);
+				count -= checked;
+				continue;
+			}
+
+			// No ant can reach an edge within `chunk` rounds, so the ants step through raw cell pointers.
+			uint8_t *data = grid.getData().data();
+			const ptrdiff_t offsets[4] = {-ptrdiff_t(length), 1, ptrdiff_t(length), -1};
+			for (size_t i = 0; i < ants.size(); ++i) {
+				cells[i] = data + size_t(ants[i].y) * length + ants[i].x;
+				directions[i] = ants[i].direction;
+			}
+
+			for (size_t round = 0; round < chunk; ++round) {
+				for (size_t j = 0; j < ants.size(); ++j) {
+					const size_t i = BACKWARD? ants.size() - 1 - j : j;
+					const Rule &rule = ants[i].rule;
+					if (BACKWARD) {
+						cells[i] -= offsets[directions[i]];
+						const uint8_t color = *cells[i];
+						*cells[i] = rule.getPreviousColor(color);
+						directions[i] = (directions[i] - rule.getUndoTurn(color)) & 3;
+					} else {
+						uint8_t &cell = *cells[i];
+						const uint8_t color = cell;
+						directions[i] = (directions[i] + rule.getTurn(color)) & 3;
+						cell = rule.getNextColor(color);
+						cells[i] += offsets[directions[i]];
+					}
+				}
+			}
+
+			for (size_t i = 0; i < ants.size(); ++i) {
+				const size_t index = cells[i] - data;
+				ants[i].x = Coord(index % length);
+				ants[i].y = Coord(index / length);
+				ants[i].direction = directions[i];
+			}
+
+			count -= chunk;
+		}
+	}
+}
+
+bool Ant::parseDirection(std::string_view name, uint8_t &direction) {
+	if (name == "up") {
+		direction = 0;
+	} else if (name == "right") {
+		direction = 1;
+	} else if (name == "down") {
+		direction = 2;
+	} else if (name == "left") {
+		direction = 3;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+const Rule & Ant::widestRule(std::span<const Ant> ants) {
+	return std::max_element(ants.begin(), ants.end(), [](const Ant &a, const Ant &b) { return a.rule.colors() < b.rule.colors(); })->rule;
+}
+
+void simulate(Grid<uint8_t, Coord> &grid, std::span<Ant> ants, size_t count) {
+	if (ants.size() == 1)
+		simulate(grid, ants[0].x, ants[0].y, ants[0].direction, count, ants[0].rule);
+	else
+		run<false>(grid, ants, count);
+}
+
+void reverse(Grid<uint8_t, Coord> &grid, std::span<Ant> ants, size_t count) {
+	if (ants.size() == 1)
+		reverse(grid, ants[0].x, ants[0].y, ants[0].direction, count, ants[0].rule);
+	else
+		run<true>(grid, ants, count);
+}
+
+bool isExactlyReversible(std::span<const Ant> ants) {
+	return !ants[0].rule.isDefault() && std::all_of(ants.begin(), ants.end(), [&](const Ant &ant) { return ant.rule == ants[0].rule; });
+}
+
+void simulatePartitioned(Grid<uint8_t, Coord> &grid, std::span<Ant> ants, size_t count, size_t workers) {
+	if (ants.size() == 1 || workers <= 1) {
+		simulate(grid, ants, count);
+		return;
+	}
+
+	std::vector<size_t> by_column(ants.size());
+	std::vector<size_t> parents(ants.size());
+	std::vector<std::vector<size_t>> groups;
+
+	// Epochs can be short, so the workers stay up for the whole run and meet at a barrier before and after each one.
+	std::barrier sync(workers);
+	std::atomic_size_t next_bundle = 0;
+	size_t epoch_rounds = 0;
+	bool finished = false;
+
+	// Each worker takes a bundle of groups and steps all their ants together, which is as valid as stepping the groups
+	// one by one but lets a single thread overlap the memory accesses of several ants.
+	std::vector<std::vector<size_t>> bundles;
+	auto work = [&] {
+		std::vector<Ant> members;
+		for (size_t bundle; (bundle = next_bundle.fetch_add(1, std::memory_order_relaxed)) < bundles.size();) {
+			members.clear();
+			for (size_t ant: bundles[bundle])
+				members.push_back(std::move(ants[ant]));
+			simulate(grid, members, epoch_rounds);
+			for (size_t i = 0; i < members.size(); ++i)
+				ants[bundles[bundle][i]] = std::move(members[i]);
+		}
+	};
+
+	std::vector<std::thread> threads;
+	threads.reserve(workers - 1);
+	for (size_t worker = 1; worker < workers; ++worker) {
+		threads.emplace_back([&] {
+			for (;;) {
+				sync.arrive_and_wait();
+				if (finished)
+					return;
+				work();
+				sync.arrive_and_wait();
+			}
+		});
+	}
+
+	while (count != 0) {
+		// An epoch may not be longer than any ant is far from an edge.
+		size_t room = SIZE_MAX;
+		for (const Ant &ant: ants)
+			room = std::min(room, margin(ant, grid.getLength()));
+		if (room < MIN_EPOCH) {
+			const size_t rounds = std::min(count, MIN_EPOCH);
+			simulate(grid, ants, rounds);
+			count -= rounds;
+			continue;
+		}
+
+		// Ants within 2 * epoch of each other in both directions may meet, so they go in the same group. Sorting by
+		// column limits the pairs that have to be compared. Each group keeps the ants' original order, which is all
+		// that matters among ants that can meet.
+		auto formGroups = [&](size_t epoch) {
+			std::iota(by_column.begin(), by_column.end(), 0);
+			std::iota(parents.begin(), parents.end(), 0);
+			std::sort(by_column.begin(), by_column.end(), [&](size_t a, size_t b) { return ants[a].x < ants[b].x; });
+			const int64_t reach = 2 * int64_t(epoch);
+			for (size_t i = 0; i < by_column.size(); ++i) {
+				const Ant &a = ants[by_column[i]];
+				for (size_t j = i + 1; j < by_column.size() && int64_t(ants[by_column[j]].x) - a.x <= reach; ++j)
+					if (std::abs(int64_t(ants[by_column[j]].y) - a.y) <= reach)
+						parents[findGroup(parents, by_column[i])] = findGroup(parents, by_column[j]);
+			}
+
+			groups.clear();
+			std::vector<size_t> group_of(ants.size(), SIZE_MAX);
+			for (size_t ant = 0; ant < ants.size(); ++ant) {
+				size_t &group = group_of[findGroup(parents, ant)];
+				if (group == SIZE_MAX) {
+					group = groups.size();
+					groups.emplace_back();
+				}
+				groups[group].push_back(ant);
+			}
+		};
+
+		// Shorter epochs can split the ants into more groups. They are halved while that gives more groups and some
+		// workers would otherwise be idle.
+		size_t epoch = std::min({count, MAX_EPOCH, room});
+		formGroups(epoch);
+		while (groups.size() < workers && MIN_EPOCH < epoch) {
+			const size_t before = groups.size();
+			formGroups(std::max(MIN_EPOCH, epoch / 2));
+			if (groups.size() == before) {
+				formGroups(epoch);
+				break;
+			}
+			epoch = std::max(MIN_EPOCH, epoch / 2);
+		}
+
+		if (groups.size() == 1) {
+			simulate(grid, ants, epoch);
+		} else {
+			bundles.assign(std::min(workers, groups.size()), {});
+			for (size_t group = 0; group < groups.size(); ++group)
+				bundles[group % bundles.size()].insert(bundles[group % bundles.size()].end(), groups[group].begin(), groups[group].end());
+			for (auto &bundle: bundles)
+				std::sort(bundle.begin(), bundle.end());
+
+			next_bundle = 0;
+			epoch_rounds = epoch;
+			sync.arrive_and_wait();
+			work();
+			sync.arrive_and_wait();
+		}
+
+		count -= epoch;
+	}
+
+	finished = true;
+	sync.arrive_and_wait();
+	for (auto &thread: threads)
+		thread.join();
+}
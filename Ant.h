@@ -0,0 +1,46 @@
+#pragma once
+
+#include "Grid.h"
+#include "Rule.h"
+#include "Types.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+
+/** One of the ants on a grid, each with its own position, direction and rule. */
+struct Ant {
+	Coord x = 0;
+	Coord y = 0;
+	uint8_t direction = 0;
+	Rule rule = Rule::getDefault();
+
+	/** Parses a direction: up, right, down or left. */
+	static bool parseDirection(std::string_view, uint8_t &);
+
+	/** Returns the rule with the most colors, which decides how cells are stored and rendered. */
+	static const Rule & widestRule(std::span<const Ant>);
+};
+
+/** Runs `count` rounds in which every ant, in order, takes one step. Each ant sees the cells the ants before it
+ *  changed, so the result depends only on the ants' order. The ants' loads and stores are independent unless they meet,
+ *  so interleaving them lets their memory accesses overlap. When the grid expands, every ant moves along with it. A
+ *  single ant takes simulate() in Simulation.h. */
+void simulate(Grid<uint8_t, Coord> &, std::span<Ant>, size_t count);
+
+/** Undoes `count` rounds of simulate(), last ant first, with the same caveats as the single-ant reverse() in
+ *  Simulation.h. This is only exact if all ants have the same rule: an ant can't tell which color another rule advanced
+ *  a cell from. */
+void reverse(Grid<uint8_t, Coord> &, std::span<Ant>, size_t count);
+
+/** Returns whether reverse() gives back exactly the earlier state, cells never visited included: the ants share a rule,
+ *  and it isn't the default rule, which turns unvisited cells into 3 on the way back. */
+bool isExactlyReversible(std::span<const Ant>);
+
+/** Like simulate(), but spreads ants that are far apart over `workers` threads with exactly the same result. Time is cut
+ *  into epochs of E rounds, in which no ant can move more than E cells. Ants closer than 2E cells share a group that is
+ *  stepped in order on one thread; groups can't touch each other's cells within the epoch, so they run in parallel.
+ *  Groups are formed again every epoch as the ants move. Whenever an ant is within the shortest epoch (1024 rounds) of
+ *  an edge, the ants take that many rounds through the sequential simulate() instead, which grows the grid as needed. */
+void simulatePartitioned(Grid<uint8_t, Coord> &, std::span<Ant>, size_t count, size_t workers);
@@ -0,0 +1,185 @@
+#include "Batch.h"
+#include "Checkpoint.h"
+#include "Simulation.h"
+#include "Util.h"
+
+#include <algorithm>
+#include <chrono>
+#include <format>
+#include <iostream>
+#include <random>
+
+namespace Batch {
+	namespace {
+		std::vector<std::string_view> split(std::string_view text, char separator) {
+			std::vector<std::string_view> parts;
+			for (size_t at; (at = text.find(separator)) != std::string_view::npos; text.remove_prefix(at + 1))
+				parts.push_back(text.substr(0, at));
+			parts.push_back(text);
+			return parts;
+		}
+
+		bool parseSeed(std::string_view seed, Job &job) {
+			job.seed = seed;
+			if (seed == "empty")
+				return true;
+			const auto parts = split(seed, ':');
+			if (parts.size() != 3 || parts[0] != "random")
+				return false;
+			job.seedSize = parseNumber<size_t>(parts[1]);
+			job.seedValue = parseNumber<uint64_t>(parts[2]);
+			return 0 < job.seedSize;
+		}
+
+		std::string joinHistogram(const std::vector<uint64_t> &histogram, char separator) {
+			std::string out;
+			for (size_t color = 0; color < histogram.size(); ++color)
+				out += std::format("{}{}", color == 0? "" : std::string(1, separator), histogram[color]);
+			return out;
+		}
+
+		inline double groupStepsPerSecond(const Summary &summary) {
+			return summary.seconds == 0? 0 : summary.groupSteps / summary.seconds;
+		}
+	}
+
+	bool parseJobs(std::string_view text, std::vector<Job> &jobs) {
+		size_t line_number = 0;
+		for (std::string_view line: split(text, '\n')) {
+			++line_number;
+
+			std::vector<std::string_view> fields;
+			for (std::string_view field: split(line, ' '))
+				for (std::string_view part: split(field, '\t'))
+					if (!part.empty() && part != "\r")
+						fields.push_back(part.ends_with('\r')? part.substr(0, part.size() - 1) : part);
+
+			if (fields.empty() || fields[0].starts_with('#'))
+				continue;
+
+			Job job;
+			if (fields.size() < 2 || 3 < fields.size()) {
+				std::cerr << std::format("Line {}: expected RULE STEPS [SEED]\n", line_number);
+				return false;
+			}
+
+			if (!Rule::parse(fields[0], job.rule)) {
+				std::cerr << std::format("Line {}: invalid rule {}\n", line_number, fields[0]);
+				return false;
+			}
+
+			job.steps = parseNumber<size_t>(fields[1]);
+
+			if (fields.size() == 3 && !parseSeed(fields[2], job)) {
+				std::cerr << std::format("Line {}: invalid seed {}; expected empty or random:SIZE:SEED\n", line_number, fields[2]);
+				return false;
+			}
+
+			jobs.push_back(std::move(job));
+		}
+
+		return true;
+	}
+
+	Lockstep::Ant Arena::start(const Job &job) {
+		// A grid that an earlier job grew huge would make every later job scan it for bounds, so it's dropped instead.
+		if (MAX_REUSED_LENGTH < grid.getLength()) {
+			grid = Grid<uint8_t, Coord>(1);
+			dirty = {};
+		}
+
+		// Start exactly where a fresh grid would: on the origin, facing up.
+		grid.clear(dirty);
+		x = grid.getOrigin();
+		y = x;
+		direction = 0;
+
+		if (job.seedSize != 0) {
+			const size_t half = job.seedSize / 2;
+			while (size_t(x) < half || grid.getLength() <= x + job.seedSize - half)
+				grid.expand(x, y);
+
+			std::mt19937_64 random(job.seedValue);
+			std::uniform_int_distribution<int> color(0, job.rule.colors() - 1);
+			const size_t length = grid.getLength();
+			for (size_t row = y - half; row < y - half + job.seedSize; ++row)
+				for (size_t column = x - half; column < x - half + job.seedSize; ++column)
+					grid.getData()[row * length + column] = color(random);
+		}
+
+		return {&grid, &job.rule, x, y, direction, job.steps - std::min(job.steps, Highway::WINDOW)};
+	}
+
+	Summary Arena::finish(const Job &job, const Lockstep::Ant &ant, double seconds) {
+		x = ant.x;
+		y = ant.y;
+		direction = ant.direction;
+
+		Summary summary;
+		const auto began = std::chrono::steady_clock::now();
+		summary.highway = Highway::detect(grid, x, y, direction, std::min(job.steps, Highway::WINDOW), job.rule);
+		summary.seconds = seconds + std::chrono::duration<double>(std::chrono::steady_clock::now() - began).count();
+
+		// Only cells within `steps` of the start, or seeded, can be nonzero, which saves scanning all of a grid that an
+		// earlier job grew. Every worker is busy with its own job, so scanning in parallel would only oversubscribe the
+		// cores.
+		const size_t reach = std::max(job.steps, job.seedSize) + 1;
+		const size_t start = grid.getOrigin();
+		const size_t length = grid.getLength();
+		const size_t near = start - std::min(start, reach);
+		const size_t far = std::min(length, start + reach + 1);
+		dirty = grid.getBounds({near, near, far, far}, false);
+		if (!dirty.empty()) {
+			const int64_t origin = grid.getOrigin();
+			summary.left = int64_t(dirty.left) - origin;
+			summary.top = int64_t(dirty.top) - origin;
+			summary.width = dirty.width();
+			summary.height = dirty.height();
+		}
+
+		summary.histogram.assign(job.rule.colors(), 0);
+		for (size_t row = dirty.top; row < dirty.bottom; ++row)
+			for (size_t column = dirty.left; column < dirty.right; ++column)
+				++summary.histogram[grid.getData()[row * length + column]];
+
+		return summary;
+	}
+
+	Summary Arena::run(const Job &job) {
+		Lockstep::Ant ant = start(job);
+		const auto began = std::chrono::steady_clock::now();
+		simulate(grid, ant.x, ant.y, ant.direction, ant.steps, job.rule);
+		return finish(job, ant, std::chrono::duration<double>(std::chrono::steady_clock::now() - began).count());
+	}
+
+	std::vector<uint8_t> Arena::save(const Job &job) const {
+		const Ant ant{x, y, direction, job.rule};
+		return Checkpoint::save(grid, std::span(&ant, 1), job.steps);
+	}
+
+	void writeCSV(std::ostream &stream, const std::vector<Job> &jobs, const std::vector<Summary> &summaries) {
+		stream << "job,rule,steps,seed,left,top,width,height,histogram,highway_period,highway_dx,highway_dy,group,seconds,group_steps_per_second\n";
+		for (size_t i = 0; i < jobs.size(); ++i) {
+			const Job &job = jobs[i];
+			const Summary &summary = summaries[i];
+			stream << std::format("{},{},{},{},{},{},{},{},{},{},{},{},{},{:.6f},{:.0f}\n", i, job.rule.getName(), job.steps, job.seed,
+				summary.left, summary.top, summary.width, summary.height, joinHistogram(summary.histogram, ';'),
+				summary.highway.period, summary.highway.dx, summary.highway.dy, summary.group, summary.seconds, groupStepsPerSecond(summary));
+		}
+	}
+
+	void writeJSON(std::ostream &stream, const std::vector<Job> &jobs, const std::vector<Summary> &summaries) {
+		stream << "[\n";
+		for (size_t i = 0; i < jobs.size(); ++i) {
+			const Job &job = jobs[i];
+			const Summary &summary = summaries[i];
+			const std::string highway = summary.highway.found()?
+				std::format("{{\"period\":{},\"dx\":{},\"dy\":{}}}", summary.highway.period, summary.highway.dx, summary.highway.dy) : "null";
+			stream << std::format("  {{\"job\":{},\"rule\":\"{}\",\"steps\":{},\"seed\":\"{}\",\"bounds\":{{\"left\":{},\"top\":{},\"width\":{},\"height\":{}}},"
+				"\"histogram\":[{}],\"highway\":{},\"group\":{},\"seconds\":{:.6f},\"group_steps_per_second\":{:.0f}}}{}\n", i, job.rule.getName(),
+				job.steps, job.seed, summary.left, summary.top, summary.width, summary.height, joinHistogram(summary.histogram, ','), highway,
+				summary.group, summary.seconds, groupStepsPerSecond(summary), i + 1 == jobs.size()? "" : ",");
+		}
+		stream << "]\n";
+	}
+}
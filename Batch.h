@@ -0,0 +1,80 @@
+#pragma once
+
+#include "Grid.h"
+#include "Highway.h"
+#include "Lockstep.h"
+#include "Rule.h"
+#include "Types.h"
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Batch {
+	/** One simulation: a rule run for a number of steps from a starting pattern. */
+	struct Job {
+		Rule rule = Rule::getDefault();
+		size_t steps = 0;
+		/** The pattern as written in the job list: `empty`, or `random:SIZE:SEED` for a SIZE x SIZE square of random
+		 *  colors centered on the ant's starting cell. */
+		std::string seed = "empty";
+		size_t seedSize = 0;
+		uint64_t seedValue = 0;
+	};
+
+	/** Parses a job list with one `RULE STEPS [SEED]` per line. Blank lines and lines starting with # are ignored.
+	 *  Prints an error and returns false on the first invalid line. */
+	bool parseJobs(std::string_view text, std::vector<Job> &);
+
+	struct Summary {
+		/** The bounding box of nonzero cells relative to the starting cell. All four are 0 if every cell is 0. */
+		int64_t left = 0;
+		int64_t top = 0;
+		size_t width = 0;
+		size_t height = 0;
+		/** How many cells of each color are in the bounding box. */
+		std::vector<uint64_t> histogram;
+		Highway::Result highway;
+		/** The lockstep group the job ran in. Jobs of one group ran interleaved on one thread, so they share `seconds`,
+		 *  the time the whole group took, and `groupSteps`, the steps of all its jobs. */
+		size_t group = 0;
+		uint64_t groupSteps = 0;
+		double seconds = 0;
+	};
+
+	/** Memory that one worker reuses from job to job. The grid keeps the size the largest job so far needed, up to a limit,
+	 *  and only the area the previous job touched is cleared, so most jobs never allocate or expand. */
+	class Arena {
+		private:
+			/** The longest grid kept for the next job. */
+			static constexpr size_t MAX_REUSED_LENGTH = 4096;
+
+			Grid<uint8_t, Coord> grid{1};
+			/** The nonzero cells left by the previous job. */
+			Bounds dirty;
+			Coord x = 0;
+			Coord y = 0;
+			uint8_t direction = 0;
+
+		public:
+			/** Clears and seeds the grid for a job and returns its ant, left to run every step but the ones finish()
+			 *  records to look for a highway. The ant can be run on its own or in lockstep with other arenas' ants. */
+			Lockstep::Ant start(const Job &);
+
+			/** Takes the ant back after it has run, runs the recorded steps and summarizes the job. `seconds` is how long
+			 *  the ant took. */
+			Summary finish(const Job &, const Lockstep::Ant &, double seconds);
+
+			/** Runs a job by itself. */
+			Summary run(const Job &);
+
+			/** Compresses the finished job's state into a checkpoint that langton can resume and langton-render can
+			 *  render. */
+			std::vector<uint8_t> save(const Job &) const;
+	};
+
+	void writeCSV(std::ostream &, const std::vector<Job> &, const std::vector<Summary> &);
+	void writeJSON(std::ostream &, const std::vector<Job> &, const std::vector<Summary> &);
+}
@@ -0,0 +1,123 @@
+#include "BlockCache.h"
+#include "Simulation.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+BlockCache::BlockCache(size_t capacity):
+	entries(std::bit_ceil(std::max(capacity, WAYS))) {}
+
+uint64_t BlockCache::hash(const Cells &cells, uint8_t entry, uint8_t direction) {
+	uint64_t hash = uint64_t(entry) << 2 | direction;
+	for (size_t i = 0; i < cells.size(); i += sizeof(uint64_t)) {
+		uint64_t word;
+		std::memcpy(&word, cells.data() + i, sizeof(word));
+		hash = (hash ^ word) * 0x9e3779b97f4a7c15;
+		hash ^= hash >> 29;
+	}
+	return hash ^ hash >> 32;
+}
+
+const BlockCache::Entry * BlockCache::find(uint64_t hash, const Cells &before, uint8_t entry, uint8_t direction) {
+	Entry *ways = set(hash);
+	for (size_t way = 0; way < WAYS; ++way) {
+		Entry &candidate = ways[way];
+		if (candidate.lastUse != 0 && candidate.hash == hash && candidate.entry == entry && candidate.direction == direction &&
+		    candidate.before == before) {
+			candidate.lastUse = ++clock;
+			++hits;
+			return &candidate;
+		}
+	}
+	++misses;
+	return nullptr;
+}
+
+void BlockCache::insert(const Entry &entry) {
+	Entry *ways = set(entry.hash);
+	Entry &oldest = *std::min_element(ways, ways + WAYS, [](const Entry &a, const Entry &b) { return a.lastUse < b.lastUse; });
+	oldest = entry;
+	oldest.lastUse = ++clock;
+}
+
+void simulateCached(Grid<uint8_t, Coord> &grid, Coord &x, Coord &y, uint8_t &direction, size_t count, const Rule &rule, BlockCache &cache) {
+	constexpr Coord SIZE = Coord(BlockCache::SIZE);
+	BlockCache::Cells cells;
+	BlockCache::Entry visit;
+
+	size_t round_lookups = 0;
+	size_t round_hits = 0;
+
+	while (count != 0) {
+		if (round_lookups == BlockCache::PROBE) {
+			if (round_hits < BlockCache::PROBE / 4) {
+				const size_t steps = std::min(count, cache.bypass);
+				simulate(grid, x, y, direction, steps, rule);
+				count -= steps;
+				cache.bypass = std::min(cache.bypass * 2, BlockCache::MAX_BYPASS);
+			} else {
+				cache.bypass = BlockCache::MIN_BYPASS;
+			}
+			round_lookups = 0;
+			round_hits = 0;
+			continue;
+		}
+
+		// Grids too small for a block, and ants that just left the grid, take an ordinary step, which grows the grid.
+		const size_t length = grid.getLength();
+		if (length < BlockCache::SIZE || x < 0 || y < 0 || length <= size_t(x) || length <= size_t(y)) {
+			simulate(grid, x, y, direction, 1, rule);
+			--count;
+			continue;
+		}
+
+		const Coord left = x & ~(SIZE - 1);
+		const Coord top = y & ~(SIZE - 1);
+		uint8_t *block = grid.getData().data() + size_t(top) * length + size_t(left);
+		for (size_t row = 0; row < BlockCache::SIZE; ++row)
+			std::memcpy(cells.data() + row * BlockCache::SIZE, block + row * length, BlockCache::SIZE);
+
+		const uint8_t entry = uint8_t((y - top) * SIZE + (x - left));
+		const uint64_t hash = BlockCache::hash(cells, entry, direction);
+		const BlockCache::Entry *result = cache.find(hash, cells, entry, direction);
+		++round_lookups;
+		round_hits += result != nullptr;
+
+		if (!result || count < result->steps) {
+			// Step through the visit on a copy of the block. A visit cut short by `count` isn't worth keeping.
+			visit.hash = hash;
+			visit.before = cells;
+			visit.after = cells;
+			visit.entry = entry;
+			visit.direction = direction;
+
+			Coord cell_x = x - left, cell_y = y - top;
+			uint8_t cell_direction = direction;
+			const size_t limit = std::min(count, BlockCache::MAX_STEPS);
+			size_t steps = 0;
+			while (steps < limit && 0 <= cell_x && cell_x < SIZE && 0 <= cell_y && cell_y < SIZE) {
+				auto &color = visit.after[size_t(cell_y) * BlockCache::SIZE + size_t(cell_x)];
+				cell_direction = (cell_direction + rule.getTurn(color)) & 3;
+				color = rule.getNextColor(color);
+				applyOffset(cell_direction, cell_x, cell_y);
+				++steps;
+			}
+
+			visit.exitX = int8_t(cell_x);
+			visit.exitY = int8_t(cell_y);
+			visit.exitDirection = cell_direction;
+			visit.steps = uint16_t(steps);
+			if (steps == BlockCache::MAX_STEPS || cell_x < 0 || SIZE <= cell_x || cell_y < 0 || SIZE <= cell_y)
+				cache.insert(visit);
+			result = &visit;
+		}
+
+		for (size_t row = 0; row < BlockCache::SIZE; ++row)
+			std::memcpy(block + row * length, result->after.data() + row * BlockCache::SIZE, BlockCache::SIZE);
+		x = left + result->exitX;
+		y = top + result->exitY;
+		direction = result->exitDirection;
+		count -= result->steps;
+	}
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "Grid.h"
+#include "Rule.h"
+#include "Types.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/** Remembers what the ant does inside small square blocks of the grid. A visit to a block is identified by the block's
+ *  cells and the cell and direction the ant enters with; it ends when the ant leaves the block, or after MAX_STEPS.
+ *  Whenever the same block, entry and direction come up again, the recorded outcome is written back in one go instead
+ *  of being stepped through. Blocks are aligned to the grid, which keeps being the only storage. */
+class BlockCache {
+	public:
+		/** Blocks are SIZE x SIZE cells. */
+		constexpr static size_t SIZE = 8;
+		/** The longest visit that is recorded in one entry, so that ants circling inside a block still make progress. */
+		constexpr static size_t MAX_STEPS = 1024;
+		/** Visits are looked up in rounds of this many. A round with fewer than a quarter hits means the ant is somewhere
+		 *  too irregular for the cache, and the next steps are simulated directly instead, doubling in number for each
+		 *  such round in a row up to MAX_BYPASS. */
+		constexpr static size_t PROBE = 4096;
+		constexpr static size_t MIN_BYPASS = size_t(1) << 16;
+		constexpr static size_t MAX_BYPASS = size_t(1) << 26;
+		/** Entries are grouped into sets of this many, and a new entry replaces the least recently used one of its set. */
+		constexpr static size_t WAYS = 4;
+
+		using Cells = std::array<uint8_t, SIZE * SIZE>;
+
+		struct Entry {
+			uint64_t hash = 0;
+			Cells before{};
+			Cells after{};
+			/** The cell the ant entered (row * SIZE + column) and the direction it faced. */
+			uint8_t entry = 0;
+			uint8_t direction = 0;
+			/** Where the ant ended up relative to the block's top left corner, which is outside the block if it left. */
+			int8_t exitX = 0;
+			int8_t exitY = 0;
+			uint8_t exitDirection = 0;
+			uint16_t steps = 0;
+			/** When the entry was last used, for replacement. 0 if it is empty. */
+			uint64_t lastUse = 0;
+		};
+
+	private:
+		std::vector<Entry> entries;
+		uint64_t clock = 0;
+		size_t hits = 0;
+		size_t misses = 0;
+		/** How many steps the next poor round bypasses the cache for. */
+		size_t bypass = MIN_BYPASS;
+
+		friend void simulateCached(Grid<uint8_t, Coord> &, Coord &, Coord &, uint8_t &, size_t, const Rule &, BlockCache &);
+
+		inline Entry * set(uint64_t hash) { return &entries[(hash & (entries.size() / WAYS - 1)) * WAYS]; }
+
+	public:
+		/** Holds at least `capacity` entries, rounded up to a power of two. */
+		explicit BlockCache(size_t capacity);
+
+		static uint64_t hash(const Cells &, uint8_t entry, uint8_t direction);
+
+		/** Returns the entry for a visit, or nullptr if it isn't cached. */
+		const Entry * find(uint64_t hash, const Cells &before, uint8_t entry, uint8_t direction);
+
+		/** Records a visit, replacing the least recently used entry of its set. */
+		void insert(const Entry &);
+
+		inline size_t getHits() const { return hits; }
+		inline size_t getMisses() const { return misses; }
+};
+
+/** Runs `count` steps of the rule like simulate() in Simulation.h with exactly the same result, a block visit at a time
+ *  through the cache. */
+void simulateCached(Grid<uint8_t, Coord> &, Coord &x, Coord &y, uint8_t &direction, size_t count, const Rule &, BlockCache &);
@@ -0,0 +1,707 @@
+#include "Checkpoint.h"
+#include "Hash.h"
+#include "Pack.h"
+#include "Parallel.h"
+#include "Zstd.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <format>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace Checkpoint {
+	namespace {
+		/** Large writes keep the number of syscalls negligible even for multi-GiB checkpoints. */
+		constexpr size_t WRITE_CHUNK = size_t(64) << 20;
+
+		std::filesystem::path generationPath(const std::filesystem::path &path, size_t generation) {
+			if (generation == 0)
+				return path;
+			std::filesystem::path out = path;
+			out += std::format(".{}", generation);
+			return out;
+		}
+
+		bool writeAll(int fd, std::span<const uint8_t> data) {
+			while (!data.empty()) {
+				const ssize_t written = ::write(fd, data.data(), std::min(data.size(), WRITE_CHUNK));
+				if (written < 0) {
+					if (errno == EINTR)
+						continue;
+					return false;
+				}
+				data = data.subspan(written);
+			}
+			return true;
+		}
+
+		bool syncDirectory(const std::filesystem::path &path) {
+			std::filesystem::path directory = path.parent_path();
+			if (directory.empty())
+				directory = ".";
+			const int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+			if (fd < 0)
+				return false;
+			const bool ok = ::fsync(fd) == 0;
+			::close(fd);
+			return ok;
+		}
+
+		constexpr uint32_t tag(const char (&name)[5]) {
+			return uint32_t(uint8_t(name[0])) | uint32_t(uint8_t(name[1])) << 8 | uint32_t(uint8_t(name[2])) << 16 | uint32_t(uint8_t(name[3])) << 24;
+		}
+
+		/** Checkpoints before version 2 had no magic number and start directly with the ant's x coordinate. */
+		constexpr uint32_t MAGIC = tag("LGTN");
+		constexpr uint32_t VERSION = 2;
+
+		/** Builds the uncompressed checkpoint: a magic number and version followed by sections, each a tag and a size. */
+		class Writer {
+			private:
+				std::vector<uint8_t> data;
+				size_t sectionStart = 0;
+
+			public:
+				Writer(size_t capacity) {
+					data.reserve(capacity);
+				}
+
+				template <typename T>
+				void put(const T &item) {
+					const size_t offset = data.size();
+					data.resize(offset + sizeof(item));
+					std::memcpy(data.data() + offset, &item, sizeof(item));
+				}
+
+				void put(std::span<const uint8_t> bytes) {
+					data.insert(data.end(), bytes.begin(), bytes.end());
+				}
+
+				/** Appends `size` uninitialized bytes and returns a pointer to them. */
+				uint8_t * extend(size_t size) {
+					const size_t offset = data.size();
+					data.resize(offset + size);
+					return data.data() + offset;
+				}
+
+				void begin(uint32_t section_tag) {
+					put(section_tag);
+					sectionStart = data.size();
+					put(uint64_t(0));
+				}
+
+				void end() {
+					const uint64_t size = data.size() - sectionStart - sizeof(uint64_t);
+					std::memcpy(data.data() + sectionStart, &size, sizeof(size));
+				}
+
+				inline std::span<const uint8_t> getData() const { return data; }
+		};
+
+		class Reader {
+			private:
+				std::span<const uint8_t> data;
+				size_t offset = 0;
+
+			public:
+				Reader(std::span<const uint8_t> data_):
+					data(data_) {}
+
+				std::span<const uint8_t> take(size_t size) {
+					if (data.size() - offset < size) {
+						std::cerr << "Checkpoint is truncated\n";
+						std::terminate();
+					}
+					auto out = data.subspan(offset, size);
+					offset += size;
+					return out;
+				}
+
+				template <typename T>
+				T get() {
+					T out;
+					std::memcpy(&out, take(sizeof(out)).data(), sizeof(out));
+					return out;
+				}
+
+				/** Reads a section size and returns a reader over the section's contents. */
+				Reader section() {
+					const auto size = get<uint64_t>();
+					return Reader(take(size));
+				}
+
+				inline bool done() const { return offset == data.size(); }
+				inline size_t size() const { return data.size() - offset; }
+				inline size_t getOffset() const { return offset; }
+		};
+
+		enum class GridEncoding: uint8_t {
+			/** One byte per cell in row-major order. */
+			Raw = 0,
+			/** The grid split into square tiles: a map of tile indices followed by each distinct tile stored once. */
+			Tiled = 1,
+			/** Like Tiled, but with the distinct tiles packed to a number of bits per cell given after the encoding. */
+			PackedTiled = 2,
+		};
+
+		/** The side length of deduplicated tiles. 64x64 tiles are small enough that margins and highway segments repeat
+		 *  exactly and large enough that the tile map stays under 0.1% of the grid. */
+		constexpr size_t DEDUP_TILE = 64;
+
+		void copyTile(const Grid<uint8_t, Coord> &grid, size_t tile_length, size_t tile_x, size_t tile_y, uint8_t *out) {
+			const size_t length = grid.getLength();
+			const uint8_t *source = grid.getData().data() + tile_y * tile_length * length + tile_x * tile_length;
+			for (size_t row = 0; row < tile_length; ++row)
+				std::memcpy(out + row * tile_length, source + row * length, tile_length);
+		}
+
+		void writeTiledGrid(Writer &writer, const Grid<uint8_t, Coord> &grid, uint8_t bits) {
+			const size_t length = grid.getLength();
+			const size_t tile_length = std::min(DEDUP_TILE, length);
+			const size_t tile_size = tile_length * tile_length;
+			const size_t tiles_per_row = length / tile_length;
+			const size_t tile_count = tiles_per_row * tiles_per_row;
+
+			std::vector<uint64_t> hashes(tile_count);
+			parallelFor(tiles_per_row, [&](size_t tile_y) {
+				std::vector<uint8_t> buffer(tile_size);
+				for (size_t tile_x = 0; tile_x < tiles_per_row; ++tile_x) {
+					copyTile(grid, tile_length, tile_x, tile_y, buffer.data());
+					hashes[tile_y * tiles_per_row + tile_x] = Hash::hash(buffer);
+				}
+			});
+
+			// Tiles with equal hashes are compared byte for byte, so a hash collision can only cost space, never correctness.
+			std::vector<uint32_t> map(tile_count);
+			std::vector<uint32_t> unique_tiles;
+			std::unordered_map<uint64_t, uint32_t> by_hash;
+			std::vector<uint8_t> candidate(tile_size), existing(tile_size);
+
+			for (size_t tile = 0; tile < tile_count; ++tile) {
+				auto [iter, inserted] = by_hash.try_emplace(hashes[tile], uint32_t(unique_tiles.size()));
+				if (!inserted) {
+					const uint32_t original = unique_tiles[iter->second];
+					copyTile(grid, tile_length, tile % tiles_per_row, tile / tiles_per_row, candidate.data());
+					copyTile(grid, tile_length, original % tiles_per_row, original / tiles_per_row, existing.data());
+					if (candidate == existing) {
+						map[tile] = iter->second;
+						continue;
+					}
+				}
+				map[tile] = uint32_t(unique_tiles.size());
+				unique_tiles.push_back(uint32_t(tile));
+			}
+
+			writer.put(uint32_t(tile_length));
+			writer.put(uint64_t(unique_tiles.size()));
+			writer.put(std::span(reinterpret_cast<const uint8_t *>(map.data()), map.size() * sizeof(uint32_t)));
+
+			const size_t packed_size = Pack::packedSize(tile_size, bits);
+			uint8_t *out = writer.extend(unique_tiles.size() * packed_size);
+			parallelFor(unique_tiles.size(), [&](size_t unique) {
+				std::vector<uint8_t> buffer(tile_size);
+				const uint32_t tile = unique_tiles[unique];
+				copyTile(grid, tile_length, tile % tiles_per_row, tile / tiles_per_row, buffer.data());
+				Pack::pack(buffer.data(), tile_size, bits, out + unique * packed_size);
+			});
+
+			std::cerr << std::format("Deduplicated {} tile{} into {} unique ({:.2f}x) at {} bit{} per cell ({:.2f} MiB instead of {:.2f} MiB).\n",
+				tile_count, tile_count == 1? "" : "s", unique_tiles.size(), double(tile_count) / unique_tiles.size(), bits, bits == 1? "" : "s",
+				(unique_tiles.size() * packed_size + tile_count * sizeof(uint32_t)) / (1024. * 1024.), grid.getSize() / (1024. * 1024.));
+		}
+
+		template <typename T>
+		std::span<const uint8_t> asBytes(const std::vector<T> &items) {
+			return {reinterpret_cast<const uint8_t *>(items.data()), items.size() * sizeof(T)};
+		}
+
+		/** Loads stored visit counts into whichever counter the heatmap uses, saturating if it is narrower. */
+		template <typename Stored>
+		void loadCounts(std::span<const uint8_t> bytes, size_t length, Heatmap &heatmap) {
+			auto fill = [&](auto &visits) {
+				using Count = std::remove_reference_t<decltype(visits.getData()[0])>;
+				visits = std::remove_reference_t<decltype(visits)>(length);
+				auto &data = visits.getData();
+				for (size_t i = 0; i < data.size(); ++i) {
+					Stored count;
+					std::memcpy(&count, bytes.data() + i * sizeof(Stored), sizeof(Stored));
+					data[i] = Count(std::min<uint64_t>(count, std::numeric_limits<Count>::max()));
+				}
+			};
+
+			if (auto *visits = heatmap.getVisits16())
+				fill(*visits);
+			else if (auto *visits = heatmap.getVisits32())
+				fill(*visits);
+		}
+	}
+
+	Snapshot::Snapshot(std::span<const uint8_t> compressed):
+		raw(Zstd::decompress(compressed)) {
+		Reader reader(raw);
+		if (raw.size() < sizeof(MAGIC) || reader.get<uint32_t>() != MAGIC)
+			parseLegacy();
+		else
+			parse();
+	}
+
+	void Snapshot::parseLegacy() {
+		Reader reader(raw);
+		x = reader.get<Coord>();
+		y = reader.get<Coord>();
+		length = reader.get<size_t>();
+		direction = reader.get<uint8_t>();
+		steps = reader.get<size_t>();
+		cells = reader.take(length * length);
+	}
+
+	void Snapshot::parse() {
+		Reader reader(raw);
+		reader.get<uint32_t>();
+
+		if (const auto version = reader.get<uint32_t>(); version != VERSION) {
+			std::cerr << std::format("Unsupported checkpoint version: {}\n", version);
+			std::terminate();
+		}
+
+		bool has_head = false;
+		bool has_grid = false;
+		bool has_hash = false;
+
+		while (!reader.done()) {
+			// The checksum covers everything before it, so nothing may follow it.
+			if (has_hash) {
+				std::cerr << "Checkpoint has data after its checksum\n";
+				std::terminate();
+			}
+
+			const size_t section_start = reader.getOffset();
+			const auto section_tag = reader.get<uint32_t>();
+			Reader section = reader.section();
+
+			if (section_tag == tag("HEAD")) {
+				x = section.get<Coord>();
+				y = section.get<Coord>();
+				direction = section.get<uint8_t>();
+				steps = section.get<size_t>();
+				has_head = true;
+			} else if (section_tag == tag("GRID")) {
+				length = section.get<size_t>();
+				const auto encoding = section.get<GridEncoding>();
+				if (encoding == GridEncoding::Raw) {
+					cells = section.take(length * length);
+					has_grid = true;
+					continue;
+				}
+
+				if (encoding == GridEncoding::Tiled) {
+					bits = 8;
+				} else if (encoding == GridEncoding::PackedTiled) {
+					bits = section.get<uint8_t>();
+				} else {
+					std::cerr << std::format("Unsupported grid encoding: {}\n", int(encoding));
+					std::terminate();
+				}
+
+				tileLength = section.get<uint32_t>();
+				if (tileLength == 0 || length % tileLength != 0) {
+					std::cerr << std::format("Invalid tile length {} for grid length {}\n", tileLength, length);
+					std::terminate();
+				}
+
+				const size_t tiles_per_row = length / tileLength;
+				uniqueCount = section.get<uint64_t>();
+				tileMap = section.take(tiles_per_row * tiles_per_row * sizeof(uint32_t));
+				cells = section.take(uniqueCount * Pack::packedSize(tileLength * tileLength, bits));
+
+				std::atomic_bool valid = true;
+				parallelFor(tiles_per_row, [&](size_t tile_y) {
+					for (size_t tile_x = 0; tile_x < tiles_per_row; ++tile_x) {
+						uint32_t unique;
+						std::memcpy(&unique, tileMap.data() + (tile_y * tiles_per_row + tile_x) * sizeof(unique), sizeof(unique));
+						if (uniqueCount <= unique)
+							valid = false;
+					}
+				});
+
+				if (!valid) {
+					std::cerr << "Checkpoint tile map refers to a nonexistent tile\n";
+					std::terminate();
+				}
+
+				has_grid = true;
+			} else if (section_tag == tag("RULE")) {
+				const auto name = section.take(section.size());
+				rule.assign(name.begin(), name.end());
+			} else if (section_tag == tag("ANTS")) {
+				ants = section.take(section.size());
+			} else if (section_tag == tag("HVIS") && has_grid) {
+				visitWidth = section.get<uint8_t>();
+				if (visitWidth != sizeof(uint16_t) && visitWidth != sizeof(uint32_t)) {
+					std::cerr << std::format("Checkpoint has visit counts of unsupported width {}\n", int(visitWidth));
+					std::terminate();
+				}
+				visits = section.take(length * length * visitWidth);
+			} else if (section_tag == tag("HLST") && has_grid) {
+				lastVisit = section.take(length * length * sizeof(uint64_t));
+			} else if (section_tag == tag("HASH")) {
+				const auto stored = section.get<uint64_t>();
+				const auto computed = Hash::tiled(std::span(raw).first(section_start));
+				if (stored != computed) {
+					std::cerr << std::format("Checkpoint checksum mismatch: stored {:016x}, computed {:016x}\n", stored, computed);
+					std::terminate();
+				}
+				std::cerr << std::format("Verified checkpoint checksum {:016x}.\n", computed);
+				has_hash = true;
+			}
+			// Unknown sections are skipped so that older builds can still read newer checkpoints' core state.
+		}
+
+		if (!has_head || !has_grid) {
+			std::cerr << "Checkpoint is missing its header or grid\n";
+			std::terminate();
+		}
+		if (!has_hash) {
+			std::cerr << "Checkpoint has no checksum, so it can't be verified\n";
+			std::terminate();
+		}
+	}
+
+	bool Snapshot::getAnts(std::vector<Ant> &out) const {
+		out.clear();
+
+		if (ants.empty()) {
+			Ant &ant = out.emplace_back();
+			ant.x = x;
+			ant.y = y;
+			ant.direction = direction;
+			return rule.empty() || Rule::parse(rule, ant.rule);
+		}
+
+		Reader reader(ants);
+		const auto count = reader.get<uint32_t>();
+		for (uint32_t i = 0; i < count; ++i) {
+			Ant &ant = out.emplace_back();
+			ant.x = reader.get<Coord>();
+			ant.y = reader.get<Coord>();
+			ant.direction = reader.get<uint8_t>() & 3;
+			const auto name = reader.take(reader.get<uint16_t>());
+			if (!Rule::parse(std::string_view(reinterpret_cast<const char *>(name.data()), name.size()), ant.rule))
+				return false;
+		}
+
+		return !out.empty();
+	}
+
+	const uint8_t * Snapshot::uniqueTile(size_t tile_x, size_t tile_y) const {
+		uint32_t unique;
+		std::memcpy(&unique, tileMap.data() + (tile_y * (length / tileLength) + tile_x) * sizeof(unique), sizeof(unique));
+		return cells.data() + unique * Pack::packedSize(tileLength * tileLength, bits);
+	}
+
+	void Snapshot::readCells(size_t row, size_t column, size_t count, uint8_t *out) const {
+		if (tileLength == 0) {
+			std::memcpy(out, cells.data() + row * length + column, count);
+			return;
+		}
+
+		// Tile rows are whole bytes when tiles are at least 8 cells wide. Smaller tiles only occur in tiny grids and are
+		// unpacked in full.
+		const size_t tile_y = row / tileLength;
+		const bool whole_tile = tileLength * bits % 8 != 0;
+		const size_t row_offset = whole_tile? 0 : Pack::packedSize((row % tileLength) * tileLength, bits);
+		const size_t unpacked_offset = whole_tile? (row % tileLength) * tileLength : 0;
+		std::vector<uint8_t> buffer(whole_tile? tileLength * tileLength : tileLength);
+
+		while (count != 0) {
+			const size_t tile_x = column / tileLength;
+			const size_t start = column % tileLength;
+			const size_t taken = std::min(count, tileLength - start);
+			const uint8_t *source = uniqueTile(tile_x, tile_y) + row_offset;
+
+			if (bits == 8) {
+				std::memcpy(out, source + start, taken);
+			} else {
+				Pack::unpack(source, buffer.size(), bits, buffer.data());
+				std::memcpy(out, buffer.data() + unpacked_offset + start, taken);
+			}
+
+			out += taken;
+			column += taken;
+			count -= taken;
+		}
+	}
+
+	Bounds Snapshot::getBounds() const {
+		if (tileLength == 0) {
+			Grid<uint8_t, Coord> grid(0);
+			toGrid(grid);
+			return grid.getBounds();
+		}
+
+		// Bounds within each distinct tile, in tile coordinates.
+		const size_t tile_size = tileLength * tileLength;
+		std::vector<Bounds> unique_bounds(uniqueCount);
+		parallelFor(uniqueCount, [&](size_t unique) {
+			std::vector<uint8_t> tile(tile_size);
+			Pack::unpack(cells.data() + unique * Pack::packedSize(tile_size, bits), tile_size, bits, tile.data());
+			Bounds bounds{tileLength, tileLength, 0, 0};
+			for (size_t row = 0; row < tileLength; ++row) {
+				for (size_t column = 0; column < tileLength; ++column) {
+					if (tile[row * tileLength + column] != 0) {
+						bounds.left = std::min(bounds.left, column);
+						bounds.top = std::min(bounds.top, row);
+						bounds.right = std::max(bounds.right, column + 1);
+						bounds.bottom = std::max(bounds.bottom, row + 1);
+					}
+				}
+			}
+			unique_bounds[unique] = bounds;
+		});
+
+		const size_t tiles_per_row = length / tileLength;
+		Bounds bounds{length, length, 0, 0};
+		for (size_t tile_y = 0; tile_y < tiles_per_row; ++tile_y) {
+			for (size_t tile_x = 0; tile_x < tiles_per_row; ++tile_x) {
+				uint32_t unique;
+				std::memcpy(&unique, tileMap.data() + (tile_y * tiles_per_row + tile_x) * sizeof(unique), sizeof(unique));
+				const Bounds &tile = unique_bounds[unique];
+				if (tile.empty())
+					continue;
+				bounds.left = std::min(bounds.left, tile_x * tileLength + tile.left);
+				bounds.top = std::min(bounds.top, tile_y * tileLength + tile.top);
+				bounds.right = std::max(bounds.right, tile_x * tileLength + tile.right);
+				bounds.bottom = std::max(bounds.bottom, tile_y * tileLength + tile.bottom);
+			}
+		}
+
+		if (bounds.bottom == 0)
+			return {};
+
+		return bounds;
+	}
+
+	void Snapshot::toGrid(Grid<uint8_t, Coord> &grid) const {
+		grid = Grid<uint8_t, Coord>(length);
+
+		if (tileLength == 0) {
+			std::memcpy(grid.getData().data(), cells.data(), cells.size());
+			return;
+		}
+
+		const size_t tile_size = tileLength * tileLength;
+		const size_t tiles_per_row = length / tileLength;
+		uint8_t *out = grid.getData().data();
+
+		parallelFor(tiles_per_row, [&](size_t tile_y) {
+			std::vector<uint8_t> buffer(tile_size);
+			for (size_t tile_x = 0; tile_x < tiles_per_row; ++tile_x) {
+				const uint8_t *source = uniqueTile(tile_x, tile_y);
+				if (bits != 8) {
+					Pack::unpack(source, tile_size, bits, buffer.data());
+					source = buffer.data();
+				}
+				uint8_t *destination = out + tile_y * tileLength * length + tile_x * tileLength;
+				for (size_t row = 0; row < tileLength; ++row)
+					std::memcpy(destination + row * length, source + row * tileLength, tileLength);
+			}
+		});
+	}
+
+	void Snapshot::toHeatmap(Heatmap &heatmap) const {
+		if (visitWidth == sizeof(uint16_t))
+			loadCounts<uint16_t>(visits, length, heatmap);
+		else if (visitWidth == sizeof(uint32_t))
+			loadCounts<uint32_t>(visits, length, heatmap);
+
+		if (auto *last_visit = heatmap.getLastVisit(); last_visit && !lastVisit.empty()) {
+			*last_visit = Grid<uint64_t, Coord>(length);
+			std::memcpy(last_visit->getData().data(), lastVisit.data(), lastVisit.size());
+		}
+	}
+
+	bool parseSync(std::string_view name, Sync &sync) {
+		if (name == "none") {
+			sync = Sync::None;
+		} else if (name == "file") {
+			sync = Sync::File;
+		} else if (name == "full") {
+			sync = Sync::Full;
+		} else {
+			return false;
+		}
+		return true;
+	}
+
+	std::vector<uint8_t> save(const Grid<uint8_t, Coord> &grid, std::span<const Ant> ants, size_t steps, const Heatmap *heatmap) {
+		const size_t grid_length = grid.getLength();
+		const Ant &first = ants.front();
+		const uint8_t bits = Ant::widestRule(ants).bitsPerCell();
+
+		Writer writer(grid.getSize() + 128);
+		writer.put(MAGIC);
+		writer.put(VERSION);
+
+		writer.begin(tag("HEAD"));
+		writer.put(first.x);
+		writer.put(first.y);
+		writer.put(first.direction);
+		writer.put(steps);
+		writer.end();
+
+		writer.begin(tag("GRID"));
+		writer.put(grid_length);
+		writer.put(GridEncoding::PackedTiled);
+		writer.put(bits);
+		writeTiledGrid(writer, grid, bits);
+		writer.end();
+
+		auto putName = [&](const Rule &rule) {
+			writer.put(std::span(reinterpret_cast<const uint8_t *>(rule.getName().data()), rule.getName().size()));
+		};
+
+		writer.begin(tag("RULE"));
+		putName(first.rule);
+		writer.end();
+
+		// Older builds skip this section and see only the first ant.
+		if (1 < ants.size()) {
+			writer.begin(tag("ANTS"));
+			writer.put(uint32_t(ants.size()));
+			for (const Ant &ant: ants) {
+				writer.put(ant.x);
+				writer.put(ant.y);
+				writer.put(ant.direction);
+				writer.put(uint16_t(ant.rule.getName().size()));
+				putName(ant.rule);
+			}
+			writer.end();
+		}
+
+		if (heatmap) {
+			if (const auto *visits = heatmap->getVisits16()) {
+				writer.begin(tag("HVIS"));
+				writer.put(uint8_t(sizeof(uint16_t)));
+				writer.put(asBytes(visits->getData()));
+				writer.end();
+			} else if (const auto *visits = heatmap->getVisits32()) {
+				writer.begin(tag("HVIS"));
+				writer.put(uint8_t(sizeof(uint32_t)));
+				writer.put(asBytes(visits->getData()));
+				writer.end();
+			}
+
+			if (const auto *last_visit = heatmap->getLastVisit()) {
+				writer.begin(tag("HLST"));
+				writer.put(asBytes(last_visit->getData()));
+				writer.end();
+			}
+		}
+
+		const uint64_t checksum = Hash::tiled(writer.getData());
+		writer.begin(tag("HASH"));
+		writer.put(checksum);
+		writer.end();
+
+		return Zstd::compress(writer.getData());
+	}
+
+	size_t load(std::span<const uint8_t> compressed, Grid<uint8_t, Coord> &grid, Coord &x, Coord &y, uint8_t &direction, Heatmap *heatmap) {
+		const Snapshot snapshot(compressed);
+		snapshot.toGrid(grid);
+		x = snapshot.getX();
+		y = snapshot.getY();
+		direction = snapshot.getDirection();
+		if (heatmap)
+			snapshot.toHeatmap(*heatmap);
+		return snapshot.getSteps();
+	}
+
+	bool write(const std::filesystem::path &path, std::span<const uint8_t> data, Sync sync, size_t generations) {
+		std::filesystem::path temp_path = path;
+		temp_path += ".tmp";
+
+		const int fd = ::open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+		if (fd < 0) {
+			std::cerr << std::format("Couldn't open {}: {}\n", temp_path.string(), std::strerror(errno));
+			return false;
+		}
+
+		// Reserving the space up front turns a full disk into an immediate error instead of a truncated file and lets the
+		// filesystem allocate one contiguous extent.
+		if (const int error = ::posix_fallocate(fd, 0, data.size()); error != 0 && error != EOPNOTSUPP && error != EINVAL) {
+			std::cerr << std::format("Couldn't allocate {} bytes for {}: {}\n", data.size(), temp_path.string(), std::strerror(error));
+			::close(fd);
+			::unlink(temp_path.c_str());
+			return false;
+		}
+
+		bool ok = writeAll(fd, data);
+		if (!ok)
+			std::cerr << std::format("Couldn't write to {}: {}\n", temp_path.string(), std::strerror(errno));
+
+		if (ok && sync != Sync::None && ::fdatasync(fd) != 0) {
+			std::cerr << std::format("Couldn't sync {}: {}\n", temp_path.string(), std::strerror(errno));
+			ok = false;
+		}
+
+		if (::close(fd) != 0 && ok) {
+			std::cerr << std::format("Couldn't close {}: {}\n", temp_path.string(), std::strerror(errno));
+			ok = false;
+		}
+
+		if (!ok) {
+			::unlink(temp_path.c_str());
+			return false;
+		}
+
+		std::error_code error;
+
+		// Shift older generations up by one. The newest old generation is hard-linked rather than renamed so that `path`
+		// keeps pointing at a complete checkpoint until the final rename replaces it.
+		if (1 < generations && std::filesystem::exists(path, error)) {
+			for (size_t generation = generations - 1; 1 < generation; --generation) {
+				const auto older = generationPath(path, generation - 1);
+				if (!std::filesystem::exists(older, error))
+					continue;
+				const auto newer = generationPath(path, generation);
+				std::filesystem::rename(older, newer, error);
+				if (error)
+					std::cerr << std::format("Couldn't keep checkpoint {} as {}: {}\n", older.string(), newer.string(), error.message());
+			}
+
+			const auto previous = generationPath(path, 1);
+			std::filesystem::remove(previous, error);
+			std::filesystem::create_hard_link(path, previous, error);
+			if (error) {
+				error.clear();
+				std::filesystem::copy_file(path, previous, error);
+			}
+			if (error)
+				std::cerr << std::format("Couldn't keep previous checkpoint as {}: {}\n", previous.string(), error.message());
+		}
+
+		std::filesystem::rename(temp_path, path, error);
+		if (error) {
+			std::cerr << std::format("Couldn't rename {} to {}: {}\n", temp_path.string(), path.string(), error.message());
+			::unlink(temp_path.c_str());
+			return false;
+		}
+
+		if (sync == Sync::Full && !syncDirectory(path)) {
+			std::cerr << std::format("Couldn't sync directory of {}: {}\n", path.string(), std::strerror(errno));
+			return false;
+		}
+
+		return true;
+	}
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "Ant.h"
+#include "Grid.h"
+#include "Heatmap.h"
+#include "Rule.h"
+#include "Types.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Checkpoint {
+	/** How hard to try to get a checkpoint onto stable storage before reporting success. */
+	enum class Sync {
+		/** Leave flushing to the OS. Fast, but a power loss can leave an empty or partial file. */
+		None,
+		/** fdatasync the temp file before renaming it into place. */
+		File,
+		/** Also fsync the directory so the rename itself survives a power loss. */
+		Full,
+	};
+
+	bool parseSync(std::string_view, Sync &);
+
+	/** Serializes and compresses the state. Cells are packed to the number of bits the widest rule's colors need. The first
+	 *  ant is stored where single-ant checkpoints keep it, and any others in an ANTS section. The heatmap's companion
+	 *  grids are included if one is given. */
+	std::vector<uint8_t> save(const Grid<uint8_t, Coord> &, std::span<const Ant>, size_t steps, const Heatmap * = nullptr);
+
+	/** A decompressed and verified checkpoint whose grid is left in its stored form. Cells are unpacked on demand, so
+	 *  parts of a huge grid can be read with memory close to the checkpoint's uncompressed size rather than the grid's.
+	 *  Terminates on corrupt input. */
+	class Snapshot {
+		private:
+			std::vector<uint8_t> raw;
+			Coord x = 0;
+			Coord y = 0;
+			uint8_t direction = 0;
+			size_t steps = 0;
+			std::string rule;
+			size_t length = 0;
+			/** For raw grids, the cells. For tiled grids, the packed unique tiles. */
+			std::span<const uint8_t> cells;
+			/** For tiled grids, the index of the unique tile at each tile position. */
+			std::span<const uint8_t> tileMap;
+			size_t tileLength = 0;
+			size_t uniqueCount = 0;
+			uint8_t bits = 8;
+			uint8_t visitWidth = 0;
+			std::span<const uint8_t> visits;
+			std::span<const uint8_t> lastVisit;
+			/** The ANTS section, if the checkpoint has more than one ant. */
+			std::span<const uint8_t> ants;
+
+			void parse();
+			void parseLegacy();
+			const uint8_t * uniqueTile(size_t tile_x, size_t tile_y) const;
+
+		public:
+			explicit Snapshot(std::span<const uint8_t> compressed);
+
+			inline Coord getX() const { return x; }
+			inline Coord getY() const { return y; }
+			inline uint8_t getDirection() const { return direction; }
+			inline size_t getSteps() const { return steps; }
+			/** Returns the stored rule name, or an empty string for checkpoints that predate it. */
+			inline const std::string & getRule() const { return rule; }
+			inline size_t getLength() const { return length; }
+			/** Returns the counter the stored visit counts were recorded with, or None if there are none. */
+			inline Heatmap::Counter getHeatmapCounter() const { return visits.empty()? Heatmap::Counter::None : Heatmap::Counter(visitWidth); }
+			inline bool hasLastVisit() const { return !lastVisit.empty(); }
+
+			/** Returns every ant, or false if one has an invalid rule. Checkpoints without ANTS have the single ant
+			 *  above, with the default rule if they predate rules. */
+			bool getAnts(std::vector<Ant> &) const;
+
+			/** Copies `count` cells of row `row` starting at `column`, which must lie within the grid. Safe to call from
+			 *  several threads at once. */
+			void readCells(size_t row, size_t column, size_t count, uint8_t *out) const;
+
+			/** Returns the bounding box of nonzero cells, looking at each distinct tile only once. */
+			Bounds getBounds() const;
+
+			/** Expands the grid in full. */
+			void toGrid(Grid<uint8_t, Coord> &) const;
+
+			/** Loads any stored heatmap data that the heatmap tracks. */
+			void toHeatmap(Heatmap &) const;
+	};
+
+	/** Loads a checkpoint and returns its step count. If a heatmap is given, any stored heatmap data that it tracks is
+	 *  loaded into it. */
+	size_t load(std::span<const uint8_t> compressed, Grid<uint8_t, Coord> &, Coord &x, Coord &y, uint8_t &direction,
+	            Heatmap * = nullptr);
+
+	/** Writes `data` to a temp file next to `path`, syncs it according to `sync` and atomically renames it over `path`.
+	 *  If `generations` is greater than 1, the previous checkpoints are kept as `path.1` through `path.<generations - 1>`.
+	 *  The existing checkpoint is never modified until the new one is completely written. */
+	bool write(const std::filesystem::path &path, std::span<const uint8_t> data, Sync sync, size_t generations);
+}
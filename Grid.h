@@ -1,8 +1,25 @@
 #pragma once
 
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cstddef>
 #include <cstdint>
+#include <iterator>
 #include <vector>
 
+/** A rectangle of cells. `right` and `bottom` are exclusive. */
+struct Bounds {
+	size_t left = 0;
+	size_t top = 0;
+	size_t right = 0;
+	size_t bottom = 0;
+
+	inline size_t width() const { return right - left; }
+	inline size_t height() const { return bottom - top; }
+	inline bool empty() const { return right <= left || bottom <= top; }
+};
+
 template <typename T, typename C>
 class Grid {
 	private:
@@ -42,6 +59,61 @@ class Grid {
 			return data[size_t(y) * length + x];
 		}
 
+		/** Returns where the ant's starting cell is now. The grid always grows by centering the old grid in one twice as
+		 *  long, which moves the start by length / 4 each time, so the start depends only on the current length. */
+		inline C getOrigin() const { return getOrigin(length); }
+		static inline C getOrigin(size_t length) { return length < 2? 0 : C(length / 2 - 1); }
+
+		/** Returns the smallest rectangle containing every nonzero cell within `area` (the whole grid by default), or an
+		 *  empty rectangle if there are none. Rows are scanned in parallel unless the caller is already one of many
+		 *  threads. */
+		Bounds getBounds(bool parallel = true) const { return getBounds({0, 0, length, length}, parallel); }
+
+		Bounds getBounds(const Bounds &area, bool parallel = true) const {
+			std::vector<size_t> left(length, length), right(length, 0);
+
+			auto scan = [&](size_t row) {
+				const auto begin = data.begin() + row * length;
+				const auto first = std::find_if(begin + area.left, begin + area.right, [](const T &cell) { return cell != T{}; });
+				if (first == begin + area.right)
+					return;
+				const auto last = std::find_if(std::reverse_iterator(begin + area.right), std::reverse_iterator(first), [](const T &cell) { return cell != T{}; }).base();
+				left[row] = first - begin;
+				right[row] = last - begin;
+			};
+
+			if (parallel) {
+				parallelFor(area.height(), [&](size_t i) { scan(area.top + i); });
+			} else {
+				for (size_t row = area.top; row < area.bottom; ++row)
+					scan(row);
+			}
+
+			Bounds bounds{length, length, 0, 0};
+			for (size_t row = area.top; row < area.bottom; ++row) {
+				if (left[row] == length)
+					continue;
+				bounds.top = std::min(bounds.top, row);
+				bounds.bottom = row + 1;
+				bounds.left = std::min(bounds.left, left[row]);
+				bounds.right = std::max(bounds.right, right[row]);
+			}
+
+			if (bounds.bottom == 0)
+				return {};
+
+			return bounds;
+		}
+
+		/** Zeroes the cells in a rectangle, so that a grid whose nonzero cells are known can be reused without clearing
+		 *  all of it. */
+		void clear(const Bounds &bounds) {
+			if (bounds.empty())
+				return;
+			for (size_t row = bounds.top; row < bounds.bottom; ++row)
+				std::fill(data.begin() + row * length + bounds.left, data.begin() + row * length + bounds.right, T{});
+		}
+
 		inline auto getLength() const { return length; }
 		inline auto getSize() const { return data.size(); }
 		inline const auto & getData() const { return data; }
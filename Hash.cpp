@@ -0,0 +1,167 @@
+#include "Hash.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <vector>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+namespace Hash {
+	namespace {
+		constexpr size_t LANES = 8;
+		constexpr size_t STRIPE = LANES * sizeof(uint64_t);
+		constexpr size_t STRIPES_PER_BLOCK = 16;
+
+		constexpr uint64_t PRIME32_1 = 0x9e3779b1;
+		constexpr uint64_t PRIME64_1 = 0x9e3779b185ebca87;
+		constexpr uint64_t PRIME64_2 = 0xc2b2ae3d27d4eb4f;
+		constexpr uint64_t PRIME64_3 = 0x165667b19e3779f9;
+
+		constexpr uint64_t splitmix(uint64_t &state) {
+			uint64_t z = (state += 0x9e3779b97f4a7c15);
+			z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+			z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+			return z ^ (z >> 31);
+		}
+
+		/** One key per lane for each stripe of a block, followed by one key per lane for the scramble step. */
+		constexpr auto SECRET = [] {
+			std::array<uint64_t, LANES * (STRIPES_PER_BLOCK + 1)> secret{};
+			uint64_t state = 0x4c616e67746f6e21;
+			for (auto &key: secret)
+				key = splitmix(state);
+			return secret;
+		}();
+
+		inline uint64_t load64(const uint8_t *pointer) {
+			uint64_t out;
+			std::memcpy(&out, pointer, sizeof(out));
+			return out;
+		}
+
+		inline uint64_t mix128(uint64_t a, uint64_t b) {
+			const unsigned __int128 product = static_cast<unsigned __int128>(a) * b;
+			return uint64_t(product) ^ uint64_t(product >> 64);
+		}
+
+		inline uint64_t avalanche(uint64_t h) {
+			h ^= h >> 37;
+			h *= 0x165667919e3779f9;
+			return h ^ (h >> 32);
+		}
+
+		using Accumulators = std::array<uint64_t, LANES>;
+
+		inline void accumulate(Accumulators &acc, const uint8_t *stripe, const uint64_t *keys) {
+#ifdef __AVX2__
+			for (size_t half = 0; half < 2; ++half) {
+				auto *acc_pointer = reinterpret_cast<__m256i *>(acc.data() + 4 * half);
+				const __m256i data = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(stripe + 32 * half));
+				const __m256i key = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(keys + 4 * half));
+				const __m256i data_key = _mm256_xor_si256(data, key);
+				const __m256i product = _mm256_mul_epu32(data_key, _mm256_srli_epi64(data_key, 32));
+				const __m256i swapped = _mm256_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+				const __m256i sum = _mm256_add_epi64(_mm256_loadu_si256(acc_pointer), swapped);
+				_mm256_storeu_si256(acc_pointer, _mm256_add_epi64(product, sum));
+			}
+#else
+			for (size_t lane = 0; lane < LANES; ++lane) {
+				const uint64_t data = load64(stripe + lane * sizeof(uint64_t));
+				const uint64_t data_key = data ^ keys[lane];
+				acc[lane ^ 1] += data;
+				acc[lane] += (data_key & 0xffffffff) * (data_key >> 32);
+			}
+#endif
+		}
+
+		inline void scramble(Accumulators &acc) {
+			const uint64_t *keys = SECRET.data() + LANES * STRIPES_PER_BLOCK;
+			for (size_t lane = 0; lane < LANES; ++lane) {
+				uint64_t value = acc[lane];
+				value ^= value >> 47;
+				value ^= keys[lane];
+				acc[lane] = value * PRIME32_1;
+			}
+		}
+	}
+
+	uint64_t hash(std::span<const uint8_t> data, uint64_t seed) {
+		Accumulators acc{PRIME32_1, PRIME64_1 ^ seed, PRIME64_2, PRIME64_3 + seed, PRIME64_1 + seed, PRIME32_1 ^ seed,
+		                 PRIME64_2 - seed, PRIME64_3};
+
+		const uint8_t *pointer = data.data();
+		size_t remaining = data.size();
+
+		while (STRIPE * STRIPES_PER_BLOCK <= remaining) {
+			for (size_t stripe = 0; stripe < STRIPES_PER_BLOCK; ++stripe)
+				accumulate(acc, pointer + stripe * STRIPE, SECRET.data() + stripe * LANES);
+			scramble(acc);
+			pointer += STRIPE * STRIPES_PER_BLOCK;
+			remaining -= STRIPE * STRIPES_PER_BLOCK;
+		}
+
+		size_t stripe = 0;
+		for (; STRIPE <= remaining; ++stripe) {
+			accumulate(acc, pointer, SECRET.data() + stripe * LANES);
+			pointer += STRIPE;
+			remaining -= STRIPE;
+		}
+
+		if (remaining != 0) {
+			std::array<uint8_t, STRIPE> last{};
+			std::memcpy(last.data(), pointer, remaining);
+			accumulate(acc, last.data(), SECRET.data() + stripe * LANES);
+		}
+
+		uint64_t result = data.size() * PRIME64_1 ^ seed;
+		for (size_t lane = 0; lane < LANES; lane += 2)
+			result += mix128(acc[lane] ^ SECRET[lane], acc[lane + 1] ^ SECRET[lane + 1]);
+		return avalanche(result);
+	}
+
+	uint64_t tiled(std::span<const uint8_t> data) {
+		const size_t tiles = (data.size() + TILE_SIZE - 1) / TILE_SIZE;
+		std::vector<uint64_t> hashes(tiles);
+
+		parallelFor(tiles, [&](size_t tile) {
+			hashes[tile] = hash(data.subspan(tile * TILE_SIZE, std::min(TILE_SIZE, data.size() - tile * TILE_SIZE)), tile);
+		});
+
+		return hash({reinterpret_cast<const uint8_t *>(hashes.data()), hashes.size() * sizeof(uint64_t)}, data.size());
+	}
+
+	uint64_t fingerprint(const Grid<uint8_t, Coord> &grid, std::span<const Ant> ants) {
+		const size_t length = grid.getLength();
+		const uint8_t *cells = grid.getData().data();
+
+		Bounds bounds = grid.getBounds();
+
+		// Positions are relative to the box's top left. An empty grid has no box, so they're relative to the first ant.
+		int64_t left = bounds.left;
+		int64_t top = bounds.top;
+		if (bounds.empty()) {
+			bounds = {};
+			left = ants.front().x;
+			top = ants.front().y;
+		}
+
+		const size_t height = bounds.height();
+		const size_t width = bounds.width();
+		std::vector<uint64_t> hashes(height + 1);
+
+		parallelFor(height, [&](size_t row) {
+			hashes[row] = hash({cells + (bounds.top + row) * length + bounds.left, width}, row);
+		});
+
+		std::vector<int64_t> header{int64_t(width), int64_t(height)};
+		for (const Ant &ant: ants)
+			header.insert(header.end(), {int64_t(ant.x) - left, int64_t(ant.y) - top, ant.direction});
+		hashes[height] = hash({reinterpret_cast<const uint8_t *>(header.data()), header.size() * sizeof(int64_t)});
+
+		return hash({reinterpret_cast<const uint8_t *>(hashes.data()), hashes.size() * sizeof(uint64_t)});
+	}
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "Ant.h"
+#include "Grid.h"
+#include "Types.h"
+
+#include <cstdint>
+#include <span>
+
+/** A fast non-cryptographic 64-bit hash in the style of XXH3: eight 64-bit lanes accumulate 64-byte stripes with 32x32
+ *  multiplies, which maps directly onto AVX2. It is not bit-compatible with XXH3, but the scalar and vector paths produce
+ *  identical results, so hashes can be compared between machines. */
+namespace Hash {
+	/** The size of the independently hashed tiles that `tiled` splits its input into. */
+	constexpr size_t TILE_SIZE = size_t(1) << 20;
+
+	uint64_t hash(std::span<const uint8_t>, uint64_t seed = 0);
+
+	/** Hashes the input as a sequence of TILE_SIZE tiles in parallel and combines the tile hashes. The result depends only
+	 *  on the data, not on the number of threads. */
+	uint64_t tiled(std::span<const uint8_t>);
+
+	/** Returns a fingerprint of the simulation state that doesn't depend on how the grid happens to be allocated: it covers
+	 *  the bounding box of nonzero cells and each ant's position relative to that box and direction. Two engines that
+	 *  reach the same state produce the same fingerprint even if their grids have different sizes or offsets. */
+	uint64_t fingerprint(const Grid<uint8_t, Coord> &, std::span<const Ant>);
+}
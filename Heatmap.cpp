@@ -0,0 +1,159 @@
+#include "Heatmap.h"
+#include "Image.h"
+#include "PNG.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <vector>
+
+namespace {
+	/** A black-purple-orange-yellow ramp, similar to the inferno colormap. */
+	Palette makeRamp() {
+		constexpr uint32_t stops[] {0x000004ff, 0x420a68ff, 0x932667ff, 0xdd513aff, 0xfca50aff, 0xfcffa4ff};
+		constexpr size_t segments = std::size(stops) - 1;
+		std::vector<uint32_t> colors(256);
+		for (size_t i = 0; i < 256; ++i) {
+			const double position = i / 255. * segments;
+			const size_t segment = std::min(size_t(position), segments - 1);
+			const double t = position - segment;
+			uint32_t color = 0xff;
+			for (int shift = 24; 8 <= shift; shift -= 8) {
+				const double from = (stops[segment] >> shift) & 0xff;
+				const double to = (stops[segment + 1] >> shift) & 0xff;
+				color |= uint32_t(std::lround(from + (to - from) * t)) << shift;
+			}
+			colors[i] = color;
+		}
+		return Palette(std::move(colors));
+	}
+}
+
+Heatmap::Heatmap(Counter counter_, bool track_last_visit, size_t length):
+	counter(counter_) {
+	if (counter == Counter::Bits16)
+		visits16.emplace(length);
+	else if (counter == Counter::Bits32)
+		visits32.emplace(length);
+	if (track_last_visit)
+		lastVisit.emplace(length);
+}
+
+bool Heatmap::parseCounter(std::string_view name, Counter &counter) {
+	if (name == "16") {
+		counter = Counter::Bits16;
+	} else if (name == "32") {
+		counter = Counter::Bits32;
+	} else if (name == "none") {
+		counter = Counter::None;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+void Heatmap::follow(size_t length) {
+	Coord dummy_x = 0, dummy_y = 0;
+	if (visits16)
+		while (visits16->getLength() < length)
+			visits16->expand(dummy_x, dummy_y);
+	if (visits32)
+		while (visits32->getLength() < length)
+			visits32->expand(dummy_x, dummy_y);
+	if (lastVisit)
+		while (lastVisit->getLength() < length)
+			lastVisit->expand(dummy_x, dummy_y);
+}
+
+uint64_t Heatmap::getVisits(size_t index) const {
+	if (visits16)
+		return visits16->getData()[index];
+	if (visits32)
+		return visits32->getData()[index];
+	return 0;
+}
+
+template <typename V, bool COUNT, bool LAST>
+void Heatmap::runWith(Grid<uint8_t, Coord> &grid, Coord &x, Coord &y, uint8_t &direction, size_t count, size_t step, const Rule &rule, Grid<V, Coord> *visits) {
+	size_t length = grid.getLength();
+	follow(length);
+
+	for (size_t i = 0; i < count; ++i) {
+		auto &color = grid(x, y);
+
+		if (grid.getLength() != length) [[unlikely]] {
+			length = grid.getLength();
+			follow(length);
+		}
+
+		const size_t index = size_t(y) * length + x;
+
+		if constexpr (COUNT) {
+			auto &visit_count = visits->getData()[index];
+			if (visit_count != std::numeric_limits<V>::max())
+				++visit_count;
+		}
+
+		if constexpr (LAST)
+			lastVisit->getData()[index] = step + i + 1;
+
+		direction = (direction + rule.getTurn(color)) & 3;
+		color = rule.getNextColor(color);
+		applyOffset(direction, x, y);
+	}
+}
+
+void Heatmap::run(Grid<uint8_t, Coord> &grid, Coord &x, Coord &y, uint8_t &direction, size_t count, size_t step, const Rule &rule) {
+	if (visits16) {
+		if (lastVisit)
+			runWith<uint16_t, true, true>(grid, x, y, direction, count, step, rule, &*visits16);
+		else
+			runWith<uint16_t, true, false>(grid, x, y, direction, count, step, rule, &*visits16);
+	} else if (visits32) {
+		if (lastVisit)
+			runWith<uint32_t, true, true>(grid, x, y, direction, count, step, rule, &*visits32);
+		else
+			runWith<uint32_t, true, false>(grid, x, y, direction, count, step, rule, &*visits32);
+	} else if (lastVisit) {
+		runWith<uint16_t, false, true>(grid, x, y, direction, count, step, rule, nullptr);
+	}
+}
+
+bool Heatmap::writeImage(const std::filesystem::path &path, size_t step) const {
+	const Grid<uint64_t, Coord> *last = getLastVisit();
+	const size_t length = visits16? visits16->getLength() : visits32? visits32->getLength() : last->getLength();
+	const Palette ramp = makeRamp();
+	const bool use_visits = counter != Counter::None;
+
+	// Scale so that the largest value maps to the brightest color.
+	std::atomic<uint64_t> largest = 1;
+	parallelFor(length, [&](size_t row) {
+		uint64_t row_largest = 0;
+		for (size_t column = 0; column < length; ++column) {
+			const size_t index = row * length + column;
+			if (use_visits) {
+				row_largest = std::max(row_largest, getVisits(index));
+			} else if (const uint64_t visited = last->getData()[index]; visited != 0) {
+				row_largest = std::max(row_largest, step - (visited - 1));
+			}
+		}
+		for (uint64_t current = largest; current < row_largest && !largest.compare_exchange_weak(current, row_largest););
+	});
+
+	const double log_largest = std::log1p(double(largest));
+
+	return writeParallelPNG(path, length, length, &ramp, [&](size_t row, uint8_t *out) {
+		for (size_t column = 0; column < length; ++column) {
+			const size_t index = row * length + column;
+			double brightness;
+			if (use_visits) {
+				brightness = std::log1p(double(getVisits(index))) / log_largest;
+			} else {
+				// Cells that were never visited stay dark; recently visited cells are bright.
+				const uint64_t visited = last->getData()[index];
+				brightness = visited == 0? 0 : 1 - std::log1p(double(step - (visited - 1))) / log_largest;
+			}
+			out[column] = uint8_t(std::lround(std::clamp(brightness, 0., 1.) * 255));
+		}
+	});
+}
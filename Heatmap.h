@@ -0,0 +1,65 @@
+#pragma once
+
+#include "Grid.h"
+#include "Rule.h"
+#include "Simulation.h"
+#include "Types.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <limits>
+#include <optional>
+#include <string_view>
+
+/** Companion grids that record how often each cell was visited and the step at which it was last visited (stored plus
+ *  one, so that 0 means never). They have the same length and offset as the main grid and grow along with it. Only the
+ *  instrumented kernel, run(), touches them; the default kernel is unaffected. */
+class Heatmap {
+	public:
+		enum class Counter: uint8_t {
+			None = 0,
+			/** Visit counts saturate at 65535. */
+			Bits16 = 2,
+			/** Visit counts saturate at 4294967295. */
+			Bits32 = 4,
+		};
+
+	private:
+		Counter counter;
+		std::optional<Grid<uint16_t, Coord>> visits16;
+		std::optional<Grid<uint32_t, Coord>> visits32;
+		std::optional<Grid<uint64_t, Coord>> lastVisit;
+
+		template <typename V, bool COUNT, bool LAST>
+		void runWith(Grid<uint8_t, Coord> &grid, Coord &x, Coord &y, uint8_t &direction, size_t count, size_t step, const Rule &,
+		             Grid<V, Coord> *visits);
+
+		/** Grows the companion grids until they match the main grid's length. */
+		void follow(size_t length);
+
+	public:
+		Heatmap(Counter, bool track_last_visit, size_t length);
+
+		static bool parseCounter(std::string_view, Counter &);
+
+		inline Counter getCounter() const { return counter; }
+		inline bool tracksLastVisit() const { return lastVisit.has_value(); }
+		inline bool isEnabled() const { return counter != Counter::None || tracksLastVisit(); }
+
+		inline const Grid<uint16_t, Coord> * getVisits16() const { return visits16? &*visits16 : nullptr; }
+		inline const Grid<uint32_t, Coord> * getVisits32() const { return visits32? &*visits32 : nullptr; }
+		inline const Grid<uint64_t, Coord> * getLastVisit() const { return lastVisit? &*lastVisit : nullptr; }
+		inline Grid<uint16_t, Coord> * getVisits16() { return visits16? &*visits16 : nullptr; }
+		inline Grid<uint32_t, Coord> * getVisits32() { return visits32? &*visits32 : nullptr; }
+		inline Grid<uint64_t, Coord> * getLastVisit() { return lastVisit? &*lastVisit : nullptr; }
+
+		/** Returns the visit count of the cell at the given index, whichever counter is in use. */
+		uint64_t getVisits(size_t index) const;
+
+		/** Runs `count` steps like simulate() while recording visits. `step` is the total step count before the first. */
+		void run(Grid<uint8_t, Coord> &, Coord &x, Coord &y, uint8_t &direction, size_t count, size_t step, const Rule &);
+
+		/** Renders visit counts (on a logarithmic scale) or, if there are none, the age of each cell's last visit relative
+		 *  to `step`, as a PNG in which bright colors mean many or recent visits. */
+		bool writeImage(const std::filesystem::path &, size_t step) const;
+};
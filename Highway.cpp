@@ -0,0 +1,210 @@
+#include "Highway.h"
+#include "Simulation.h"
+
+#include <algorithm>
+#include <span>
+#include <vector>
+
+namespace Highway {
+	namespace {
+		/** A cell visited during one period, relative to where the ant started it. */
+		struct Visit {
+			Coord dx = 0;
+			Coord dy = 0;
+			uint8_t before = 0;
+			uint8_t after = 0;
+
+			inline bool operator<(const Visit &other) const { return dy != other.dy? dy < other.dy : dx < other.dx; }
+		};
+	}
+
+	Result detect(Grid<uint8_t, Coord> &grid, Coord &x, Coord &y, uint8_t &direction, size_t window, const Rule &rule) {
+		// Each step is summarized by the color read and the direction moved. The ant is on a highway exactly when this
+		// sequence is periodic, since the same moves every period add up to the same offset.
+		std::vector<uint16_t> symbols(window);
+		for (size_t i = 0; i < window; ++i) {
+			auto &color = grid(x, y);
+			direction = (direction + rule.getTurn(color)) & 3;
+			symbols[i] = uint16_t(color << 2 | direction);
+			color = rule.getNextColor(color);
+			applyOffset(direction, x, y);
+		}
+
+		// The smallest period of the second half of the window follows from its longest proper prefix that is also a
+		// suffix (the KMP failure function), in linear time however nearly periodic the ant's path is.
+		const std::span<const uint16_t> tail = std::span(symbols).subspan(window / 2);
+		std::vector<size_t> border(tail.size());
+		for (size_t i = 1; i < tail.size(); ++i) {
+			size_t length = border[i - 1];
+			while (length != 0 && tail[i] != tail[length])
+				length = border[length - 1];
+			border[i] = length + (tail[i] == tail[length]);
+		}
+
+		// It has to hold for at least four periods.
+		const size_t period = tail.size() - (tail.empty()? 0 : border.back());
+		if (tail.size() < period * 4)
+			return {};
+
+		Coord dx = 0, dy = 0;
+		for (uint16_t symbol: tail.last(period))
+			applyOffset(symbol & 3, dx, dy);
+		if (dx == 0 && dy == 0)
+			return {};
+		return {period, dx, dy};
+	}
+
+	Result run(Grid<uint8_t, Coord> &grid, Coord &x, Coord &y, uint8_t &direction, size_t count, const Rule &rule) {
+		const size_t window = std::min(count, WINDOW);
+		simulate(grid, x, y, direction, count - window, rule);
+		return detect(grid, x, y, direction, window, rule);
+	}
+
+	size_t skip(Grid<uint8_t, Coord> &grid, Coord &x, Coord &y, uint8_t &direction, const Result &highway, size_t limit, const Rule &rule) {
+		const size_t period = highway.period;
+		if (limit < 2 * period)
+			return 0;
+
+		// Offsets are tracked apart from the position, which moves if a step expands the grid.
+		const uint8_t start_direction = direction;
+		std::vector<Visit> steps(period);
+		Coord dx = 0, dy = 0;
+		for (Visit &step: steps) {
+			auto &color = grid(x, y);
+			step = {dx, dy, color, 0};
+			direction = (direction + rule.getTurn(color)) & 3;
+			color = rule.getNextColor(color);
+			step.after = color;
+			applyOffset(direction, x, y);
+			applyOffset(direction, dx, dy);
+		}
+
+		if ((dx == 0 && dy == 0) || direction != start_direction)
+			return period;
+
+		// Each cell keeps the color it had at its first visit and the one it was left with at its last.
+		std::stable_sort(steps.begin(), steps.end());
+		std::vector<Visit> cells;
+		for (const Visit &step: steps) {
+			if (!cells.empty() && cells.back().dx == step.dx && cells.back().dy == step.dy)
+				cells.back().after = step.after;
+			else
+				cells.push_back(step);
+		}
+
+		Coord left = 0, top = 0, right = 0, bottom = 0;
+		for (const Visit &cell: cells) {
+			left = std::min(left, cell.dx);
+			top = std::min(top, cell.dy);
+			right = std::max(right, cell.dx);
+			bottom = std::max(bottom, cell.dy);
+		}
+
+		auto find = [&](int64_t cell_x, int64_t cell_y) -> const Visit * {
+			if (cell_x < left || right < cell_x || cell_y < top || bottom < cell_y)
+				return nullptr;
+			const Visit key{Coord(cell_x), Coord(cell_y)};
+			const auto it = std::lower_bound(cells.begin(), cells.end(), key);
+			return it != cells.end() && it->dx == key.dx && it->dy == key.dy? &*it : nullptr;
+		};
+
+		// The smallest m >= 1 for which the cell `m` periods along (`sign` = 1) or back (-1) was also visited, or 0 if none
+		// was. It is found within the visited cells' bounding box, which the offset eventually leaves.
+		auto nearestRepeat = [&](const Visit &cell, int64_t sign) -> size_t {
+			for (size_t m = 1;; ++m) {
+				const int64_t cell_x = cell.dx + sign * int64_t(m) * dx;
+				const int64_t cell_y = cell.dy + sign * int64_t(m) * dy;
+				if (cell_x < left || right < cell_x || cell_y < top || bottom < cell_y)
+					return 0;
+				if (find(cell_x, cell_y))
+					return m;
+			}
+		};
+
+		// The period that just ran started at (start_x, start_y). Period k after it starts k offsets further and repeats it
+		// if every cell it visits first has the color the cell at the same place relative to the ant had then. A cell last
+		// written j periods earlier has that period's final color; one no earlier period reached still has its color
+		// from before.
+		const int64_t start_x = int64_t(x) - dx;
+		const int64_t start_y = int64_t(y) - dy;
+		auto colorAt = [&](int64_t cell_x, int64_t cell_y, bool &outside) -> uint8_t {
+			const size_t length = grid.getLength();
+			outside = cell_x < 0 || cell_y < 0 || int64_t(length) <= cell_x || int64_t(length) <= cell_y;
+			return outside? 0 : grid.getData()[size_t(cell_y) * length + size_t(cell_x)];
+		};
+
+		size_t periods = (limit - period) / period;
+		for (const Visit &cell: cells) {
+			const size_t repeat = nearestRepeat(cell, 1);
+			if (repeat != 0 && find(cell.dx + int64_t(repeat) * dx, cell.dy + int64_t(repeat) * dy)->after != cell.before)
+				periods = std::min(periods, repeat - 1);
+			const size_t untouched = repeat == 0? periods : std::min(periods, repeat - 1);
+			for (size_t k = 1; k <= untouched; ++k) {
+				bool outside = false;
+				const uint8_t color = colorAt(start_x + cell.dx + int64_t(k) * dx, start_y + cell.dy + int64_t(k) * dy, outside);
+				if (color != cell.before) {
+					periods = std::min(periods, k - 1);
+					break;
+				}
+				// Everything beyond the grid is 0, and the cell only gets further away.
+				if (outside)
+					break;
+			}
+		}
+
+		if (periods == 0)
+			return period;
+
+		// Make room for every cell the skipped periods write and for the ant's final position.
+		auto fits = [&](int64_t offset_x, int64_t offset_y) {
+			const int64_t length = grid.getLength();
+			const int64_t base_x = int64_t(x) - dx + offset_x;
+			const int64_t base_y = int64_t(y) - dy + offset_y;
+			return 0 <= base_x + left && base_x + right < length && 0 <= base_y + top && base_y + bottom < length;
+		};
+		const int64_t last_x = int64_t(periods) * dx;
+		const int64_t last_y = int64_t(periods) * dy;
+		while (!fits(dx, dy) || !fits(last_x + dx, last_y + dy))
+			grid.expand(x, y);
+
+		// Only the last period to visit a cell decides its color, so each period writes the cells no later one revisits.
+		const size_t length = grid.getLength();
+		uint8_t *data = grid.getData().data();
+		auto write = [&](const Visit &cell, size_t k) {
+			const size_t cell_x = size_t(int64_t(x) + cell.dx + int64_t(k - 1) * dx);
+			const size_t cell_y = size_t(int64_t(y) + cell.dy + int64_t(k - 1) * dy);
+			data[cell_y * length + cell_x] = cell.after;
+		};
+
+		std::vector<Visit> always;
+		for (const Visit &cell: cells) {
+			if (const size_t later = nearestRepeat(cell, -1); later == 0) {
+				always.push_back(cell);
+			} else {
+				for (size_t k = periods - std::min(periods, later - 1); k <= periods; ++k)
+					if (k != 0)
+						write(cell, k);
+			}
+		}
+		for (size_t k = 1; k <= periods; ++k)
+			for (const Visit &cell: always)
+				write(cell, k);
+
+		x = Coord(int64_t(x) + last_x);
+		y = Coord(int64_t(y) + last_y);
+		return (periods + 1) * period;
+	}
+
+	void advance(Grid<uint8_t, Coord> &grid, Coord &x, Coord &y, uint8_t &direction, size_t count, const Rule &rule) {
+		if (count < MIN_ADVANCE) {
+			simulate(grid, x, y, direction, count, rule);
+			return;
+		}
+
+		const Result highway = detect(grid, x, y, direction, WINDOW, rule);
+		count -= WINDOW;
+		if (highway.found())
+			count -= skip(grid, x, y, direction, highway, count, rule);
+		simulate(grid, x, y, direction, count, rule);
+	}
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "Grid.h"
+#include "Rule.h"
+#include "Types.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Highway {
+	/** A highway: the ant repeats the same sequence of `period` steps, moving by (dx, dy) each time. */
+	struct Result {
+		size_t period = 0;
+		int64_t dx = 0;
+		int64_t dy = 0;
+
+		inline bool found() const { return period != 0; }
+	};
+
+	/** The number of final steps that are recorded to look for a highway. */
+	constexpr size_t WINDOW = size_t(1) << 16;
+
+	/** Runs `count` steps of the rule and reports whether the last `count` of them put the ant on a highway: whether, over
+	 *  the second half of them, the colors it read repeat with some period of at most an eighth of `count` while the ant
+	 *  moves by the same nonzero offset every period. */
+	Result detect(Grid<uint8_t, Coord> &, Coord &x, Coord &y, uint8_t &direction, size_t count, const Rule &);
+
+	/** Runs `count` steps of the rule, recording the last WINDOW of them (or all of them, if fewer) for detect(). */
+	Result run(Grid<uint8_t, Coord> &, Coord &x, Coord &y, uint8_t &direction, size_t count, const Rule &);
+
+	/** Follows a highway that detect() just found without stepping through it. One more period is run for real, noting
+	 *  the color of every cell it visits before and after. Each following period repeats it exactly as long as the cells
+	 *  it visits start out the same relative to the ant, which holds for cells the highway itself left behind and for
+	 *  empty space ahead. Periods are checked against this until one wouldn't repeat, and the cells the repeating ones
+	 *  leave behind are then written directly. Returns how many steps were run or skipped: whole periods, at most
+	 *  `limit`. */
+	size_t skip(Grid<uint8_t, Coord> &, Coord &x, Coord &y, uint8_t &direction, const Result &, size_t limit, const Rule &);
+
+	/** The shortest run that advance() looks for a highway in. */
+	constexpr size_t MIN_ADVANCE = 4 * WINDOW;
+
+	/** Runs `count` steps like simulate() with exactly the same result, but first looks for a highway and skips along
+	 *  any it finds. */
+	void advance(Grid<uint8_t, Coord> &, Coord &x, Coord &y, uint8_t &direction, size_t count, const Rule &);
+}
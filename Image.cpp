@@ -0,0 +1,483 @@
+#include "Image.h"
+#include "Pack.h"
+#include "Parallel.h"
+#include "PNG.h"
+#include "RawImage.h"
+#include "Util.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cctype>
+#include <cmath>
+#include <cstring>
+#include <format>
+#include <iostream>
+#include <string>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+namespace {
+	/** Converts a hue in [0, 1) at full saturation and value to 0xRRGGBBAA. */
+	uint32_t hue(double h) {
+		auto channel = [h](double offset) {
+			const double value = std::clamp(std::abs(std::fmod(h * 6 + offset, 6) - 3) - 1, 0.0, 1.0);
+			return uint32_t(std::lround(value * 255));
+		};
+		return channel(0) << 24 | channel(4) << 16 | channel(2) << 8 | 0xff;
+	}
+
+	/** Pack stores the first cell in the least significant bits of each byte, but PNG wants it in the most significant. */
+	constexpr std::array<uint8_t, 256> makeReverseTable(uint8_t bits) {
+		std::array<uint8_t, 256> table{};
+		const size_t per_byte = 8 / bits;
+		const uint8_t mask = (1 << bits) - 1;
+		for (size_t byte = 0; byte < 256; ++byte) {
+			uint8_t reversed = 0;
+			for (size_t i = 0; i < per_byte; ++i)
+				reversed |= ((byte >> (i * bits)) & mask) << ((per_byte - 1 - i) * bits);
+			table[byte] = reversed;
+		}
+		return table;
+	}
+
+	constexpr std::array<std::array<uint8_t, 256>, 3> REVERSE_TABLES {makeReverseTable(1), makeReverseTable(2), makeReverseTable(4)};
+
+	/** Returns the most common of four colors; ties go to the higher color, like Filter::Majority. */
+	inline uint8_t majority(uint8_t a, uint8_t b, uint8_t c, uint8_t d) {
+		if (a == b)
+			return c == d? std::max(a, c) : a;
+		if (a == c)
+			return b == d? std::max(a, b) : a;
+		if (a == d)
+			return b == c? std::max(a, b) : a;
+		if (b == c || b == d)
+			return b;
+		if (c == d)
+			return c;
+		return std::max({a, b, c, d});
+	}
+
+#ifdef __SSE2__
+	inline __m128i select(__m128i mask, __m128i yes, __m128i no) {
+		return _mm_or_si128(_mm_and_si128(mask, yes), _mm_andnot_si128(mask, no));
+	}
+
+	/** Reduces 32 columns of two rows into 16 output cells with the same rules as majority(). */
+	inline __m128i majority16(const uint8_t *top, const uint8_t *bottom) {
+		const __m128i low_mask = _mm_set1_epi16(0xff);
+		const __m128i top0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(top));
+		const __m128i top1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(top + 16));
+		const __m128i bottom0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bottom));
+		const __m128i bottom1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bottom + 16));
+		const __m128i a = _mm_packus_epi16(_mm_and_si128(top0, low_mask), _mm_and_si128(top1, low_mask));
+		const __m128i b = _mm_packus_epi16(_mm_srli_epi16(top0, 8), _mm_srli_epi16(top1, 8));
+		const __m128i c = _mm_packus_epi16(_mm_and_si128(bottom0, low_mask), _mm_and_si128(bottom1, low_mask));
+		const __m128i d = _mm_packus_epi16(_mm_srli_epi16(bottom0, 8), _mm_srli_epi16(bottom1, 8));
+
+		const __m128i ab = _mm_cmpeq_epi8(a, b);
+		const __m128i ac = _mm_cmpeq_epi8(a, c);
+		const __m128i ad = _mm_cmpeq_epi8(a, d);
+		const __m128i bc = _mm_cmpeq_epi8(b, c);
+		const __m128i bd = _mm_cmpeq_epi8(b, d);
+		const __m128i cd = _mm_cmpeq_epi8(c, d);
+
+		// Two pairs: a with b against c with d, or a with c or d against the other two.
+		const __m128i ab_cd = _mm_and_si128(ab, cd);
+		const __m128i a_b_pairs = _mm_or_si128(_mm_and_si128(ac, bd), _mm_and_si128(ad, bc));
+		const __m128i a_wins = _mm_or_si128(ab, _mm_or_si128(ac, ad));
+		const __m128i b_wins = _mm_or_si128(bc, bd);
+		const __m128i highest = _mm_max_epu8(_mm_max_epu8(a, b), _mm_max_epu8(c, d));
+		const __m128i single = select(a_wins, a, select(b_wins, b, select(cd, c, highest)));
+		return select(ab_cd, _mm_max_epu8(a, c), select(a_b_pairs, _mm_max_epu8(a, b), single));
+	}
+#endif
+
+#ifdef __SSSE3__
+	/** Looks up 16 cells in a table split into 16-entry chunks. With a single chunk, each cell's high bits are ignored;
+	 *  otherwise every chunk is looked up and the one matching each cell's high nibble is kept. The low nibble is
+	 *  isolated first because a shuffle zeroes lanes whose index has the top bit set. */
+	inline __m128i lookup(const __m128i *chunks, size_t count, __m128i indices) {
+		const __m128i low = _mm_and_si128(indices, _mm_set1_epi8(15));
+		if (count == 1)
+			return _mm_shuffle_epi8(chunks[0], low);
+
+		const __m128i high = _mm_andnot_si128(_mm_set1_epi8(15), indices);
+		__m128i result = _mm_setzero_si128();
+		for (size_t chunk = 0; chunk < count; ++chunk) {
+			const __m128i selected = _mm_cmpeq_epi8(high, _mm_set1_epi8(char(16 * chunk)));
+			result = _mm_or_si128(result, _mm_and_si128(selected, _mm_shuffle_epi8(chunks[chunk], low)));
+		}
+		return result;
+	}
+
+#ifdef __AVX2__
+	/** Looks up 32 cells at once; the shuffles work within 128-bit lanes, so each chunk is repeated in both lanes. */
+	inline __m256i lookup(const __m128i *chunks, size_t count, __m256i indices) {
+		const __m256i low = _mm256_and_si256(indices, _mm256_set1_epi8(15));
+		if (count == 1)
+			return _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(chunks[0]), low);
+
+		const __m256i high = _mm256_andnot_si256(_mm256_set1_epi8(15), indices);
+		__m256i result = _mm256_setzero_si256();
+		for (size_t chunk = 0; chunk < count; ++chunk) {
+			const __m256i selected = _mm256_cmpeq_epi8(high, _mm256_set1_epi8(char(16 * chunk)));
+			const __m256i values = _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(chunks[chunk]), low);
+			result = _mm256_or_si256(result, _mm256_and_si256(selected, values));
+		}
+		return result;
+	}
+#endif
+
+	/** Interleaves 16 pixels' worth of channel planes and stores them as 16 * channels bytes. */
+	inline void storePixels(__m128i *planes, size_t channels, uint8_t *out) {
+		if (channels == 1) {
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(out), planes[0]);
+			return;
+		}
+
+		if (channels == 3)
+			planes[3] = _mm_setzero_si128();
+
+		// Interleave the planes into four vectors of four pixels each.
+		const __m128i low01 = _mm_unpacklo_epi8(planes[0], planes[1]);
+		const __m128i high01 = _mm_unpackhi_epi8(planes[0], planes[1]);
+		const __m128i low23 = _mm_unpacklo_epi8(planes[2], planes[3]);
+		const __m128i high23 = _mm_unpackhi_epi8(planes[2], planes[3]);
+		__m128i pixels[4] {
+			_mm_unpacklo_epi16(low01, low23), _mm_unpackhi_epi16(low01, low23),
+			_mm_unpacklo_epi16(high01, high23), _mm_unpackhi_epi16(high01, high23),
+		};
+
+		if (channels == 4) {
+			for (size_t j = 0; j < 4; ++j)
+				_mm_storeu_si128(reinterpret_cast<__m128i *>(out + 16 * j), pixels[j]);
+			return;
+		}
+
+		// Drop every fourth byte, leaving 12 bytes per vector, and stitch the four vectors into three.
+		const __m128i squeeze = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+		for (auto &vector: pixels)
+			vector = _mm_shuffle_epi8(vector, squeeze);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(out), _mm_or_si128(pixels[0], _mm_slli_si128(pixels[1], 12)));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(out + 16), _mm_or_si128(_mm_srli_si128(pixels[1], 4), _mm_slli_si128(pixels[2], 8)));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(out + 32), _mm_or_si128(_mm_srli_si128(pixels[2], 8), _mm_slli_si128(pixels[3], 4)));
+	}
+#endif
+
+	/** Converts RGBA pixels into another layout. Gray uses the Rec. 601 luma weights. */
+	void convertRGBA(const uint8_t *rgba, size_t count, PixelLayout layout, uint8_t *out) {
+		for (size_t i = 0; i < count; ++i, rgba += 4) {
+			switch (layout) {
+				case PixelLayout::Gray:
+					*out++ = (rgba[0] * 77 + rgba[1] * 150 + rgba[2] * 29 + 128) >> 8;
+					break;
+				case PixelLayout::RGB:
+					*out++ = rgba[0];
+					*out++ = rgba[1];
+					*out++ = rgba[2];
+					break;
+				case PixelLayout::BGR:
+					*out++ = rgba[2];
+					*out++ = rgba[1];
+					*out++ = rgba[0];
+					break;
+				case PixelLayout::RGBA:
+					std::memcpy(out, rgba, 4);
+					out += 4;
+					break;
+			}
+		}
+	}
+
+	/** Reads output rows of a view of the grid: cell colors for palette views, RGBA pixels for averaged ones. */
+	class ViewReader {
+		private:
+			size_t length;
+			const CellReader &reader;
+			const Palette &palette;
+			const View &view;
+
+			/** Copies `count` cells of row `y` starting at column `x` in view coordinates, filling in zeros outside the
+			 *  grid. */
+			void readCells(size_t y, size_t x, size_t count, uint8_t *out) const {
+				std::fill(out, out + count, 0);
+				const int64_t row = view.top + int64_t(y);
+				if (row < 0 || int64_t(length) <= row)
+					return;
+				const int64_t first = std::max<int64_t>(view.left + int64_t(x), 0);
+				const int64_t last = std::min<int64_t>(view.left + int64_t(x + count), length);
+				if (first < last)
+					reader(row, first, last - first, out + (first - view.left - int64_t(x)));
+			}
+
+			/** Reads the block rows of output row `y` and calls `reduce(cells, rows, output_x, columns)` for every output
+			 *  pixel, where `cells` points at the block's first cell and consecutive rows are `view.width` apart. */
+			void forEachBlock(size_t y, auto &&reduce) const {
+				const size_t scale = view.scale;
+				const size_t rows = std::min(scale, view.height - y * scale);
+				std::vector<uint8_t> block(rows * view.width);
+				for (size_t row = 0; row < rows; ++row)
+					readCells(y * scale + row, 0, view.width, block.data() + row * view.width);
+				for (size_t x = 0, width = view.outputWidth(); x < width; ++x)
+					reduce(block.data() + x * scale, rows, x, std::min(scale, view.width - x * scale));
+			}
+
+		public:
+			ViewReader(size_t length_, const CellReader &reader_, const Palette &palette_, const View &view_):
+				length(length_), reader(reader_), palette(palette_), view(view_) {}
+
+			/** Fills `out` with the outputWidth() cell colors of output row `y`. Only for palette views. */
+			void colors(size_t y, uint8_t *out) const {
+				if (view.scale == 1) {
+					readCells(y, 0, view.width, out);
+					return;
+				}
+
+				std::vector<uint32_t> counts(palette.size());
+				forEachBlock(y, [&](const uint8_t *cells, size_t rows, size_t x, size_t columns) {
+					std::fill(counts.begin(), counts.end(), 0);
+					for (size_t row = 0; row < rows; ++row)
+						for (size_t column = 0; column < columns; ++column)
+							++counts[cells[row * view.width + column]];
+					size_t best = 0;
+					for (size_t color = 1; color < counts.size(); ++color)
+						if (counts[best] <= counts[color])
+							best = color;
+					out[x] = best;
+				});
+			}
+
+			/** Fills `out` with the outputWidth() RGBA pixels of output row `y`. Only for averaged views. */
+			void averages(size_t y, uint8_t *out) const {
+				forEachBlock(y, [&](const uint8_t *cells, size_t rows, size_t x, size_t columns) {
+					uint32_t sums[4]{};
+					for (size_t row = 0; row < rows; ++row) {
+						for (size_t column = 0; column < columns; ++column) {
+							const uint32_t color = palette[cells[row * view.width + column]];
+							for (size_t channel = 0; channel < 4; ++channel)
+								sums[channel] += (color >> (24 - 8 * channel)) & 0xff;
+						}
+					}
+					const uint32_t count = rows * columns;
+					for (size_t channel = 0; channel < 4; ++channel)
+						out[4 * x + channel] = (sums[channel] + count / 2) / count;
+				});
+			}
+	};
+}
+
+ColorTable::ColorTable(const Palette &palette, PixelLayout layout_):
+layout(layout_), channels(layout == PixelLayout::Gray? 1 : layout == PixelLayout::RGBA? 4 : 3), colors(palette.size()) {
+	for (size_t color = 0; color < palette.size(); ++color) {
+		const uint32_t rgba = palette[color];
+		const uint8_t bytes[4] {uint8_t(rgba >> 24), uint8_t(rgba >> 16), uint8_t(rgba >> 8), uint8_t(rgba)};
+		uint8_t pixel[4];
+		convertRGBA(bytes, 1, layout, pixel);
+		for (size_t channel = 0; channel < channels; ++channel)
+			tables[channel][color] = pixel[channel];
+	}
+}
+
+void ColorTable::expand(const uint8_t *cells, size_t count, uint8_t *out) const {
+	size_t i = 0;
+
+#ifdef __SSSE3__
+	// Each channel's table is split into 16-color chunks that fit in one shuffle.
+	const size_t chunks = (colors + 15) / 16;
+	__m128i table[4][16];
+	for (size_t channel = 0; channel < channels; ++channel)
+		for (size_t chunk = 0; chunk < chunks; ++chunk)
+			table[channel][chunk] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(tables[channel].data() + 16 * chunk));
+
+#ifdef __AVX2__
+	for (; i + 32 <= count; i += 32) {
+		const __m256i indices = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(cells + i));
+		__m128i planes[2][4];
+		for (size_t channel = 0; channel < channels; ++channel) {
+			const __m256i plane = lookup(table[channel], chunks, indices);
+			planes[0][channel] = _mm256_castsi256_si128(plane);
+			planes[1][channel] = _mm256_extracti128_si256(plane, 1);
+		}
+		storePixels(planes[0], channels, out + channels * i);
+		storePixels(planes[1], channels, out + channels * (i + 16));
+	}
+#endif
+
+	for (; i + 16 <= count; i += 16) {
+		const __m128i indices = _mm_loadu_si128(reinterpret_cast<const __m128i *>(cells + i));
+		__m128i planes[4];
+		for (size_t channel = 0; channel < channels; ++channel)
+			planes[channel] = lookup(table[channel], chunks, indices);
+		storePixels(planes, channels, out + channels * i);
+	}
+#endif
+
+	for (; i < count; ++i)
+		for (size_t channel = 0; channel < channels; ++channel)
+			out[channels * i + channel] = tables[channel][cells[i]];
+}
+
+bool parseImageFormat(const std::filesystem::path &path, ImageFormat &format) {
+	std::string extension = path.extension().string();
+	std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return std::tolower(c); });
+
+	if (extension == ".png")
+		format = ImageFormat::PNG;
+	else if (extension == ".pgm")
+		format = ImageFormat::PGM;
+	else if (extension == ".ppm" || extension == ".pnm")
+		format = ImageFormat::PPM;
+	else if (extension == ".bmp")
+		format = ImageFormat::BMP;
+	else if (extension == ".qoi")
+		format = ImageFormat::QOI;
+	else
+		return false;
+
+	return true;
+}
+
+Palette Palette::forRule(const Rule &rule) {
+	std::vector<uint32_t> colors{0xffffffff, 0xff0000ff, 0x00ff00ff, 0x0000ffff};
+	const size_t count = std::max<size_t>(rule.colors(), 2);
+	const size_t base = colors.size();
+	for (size_t i = base; i < count; ++i)
+		colors.push_back(hue(double(i - base) / (count - base) + 1. / 12));
+	colors.resize(count);
+	return Palette(std::move(colors));
+}
+
+bool Palette::parse(std::string_view list, const Rule &rule, Palette &palette) {
+	palette = forRule(rule);
+
+	for (size_t index = 0; !list.empty(); ++index) {
+		const size_t comma = list.find(',');
+		std::string_view item = list.substr(0, comma);
+		list = comma == std::string_view::npos? std::string_view{} : list.substr(comma + 1);
+
+		if (item.starts_with('#'))
+			item.remove_prefix(1);
+
+		if ((item.size() != 6 && item.size() != 8) || item.find_first_not_of("0123456789abcdefABCDEF") != std::string_view::npos)
+			return false;
+
+		uint32_t color = parseNumber<uint32_t>(item, 16);
+		if (item.size() == 6)
+			color = color << 8 | 0xff;
+
+		if (palette.colors.size() <= index)
+			palette.colors.resize(index + 1, 0x000000ff);
+		palette.colors[index] = color;
+	}
+
+	if (256 < palette.colors.size())
+		return false;
+
+	return true;
+}
+
+uint8_t Palette::bitDepth() const {
+	if (colors.size() <= 2)
+		return 1;
+	if (colors.size() <= 4)
+		return 2;
+	if (colors.size() <= 16)
+		return 4;
+	return 8;
+}
+
+void packIndices(const uint8_t *cells, size_t count, uint8_t bits, uint8_t *out) {
+	Pack::pack(cells, count, bits, out);
+
+	if (bits != 8) {
+		const auto &table = REVERSE_TABLES[std::countr_zero(bits)];
+		for (size_t i = 0, size = Pack::packedSize(count, bits); i < size; ++i)
+			out[i] = table[out[i]];
+	}
+}
+
+void halveMajority(const uint8_t *cells, size_t width, size_t height, uint8_t *out) {
+	const size_t out_width = (width + 1) / 2;
+	const size_t out_height = (height + 1) / 2;
+
+	parallelFor((out_height + 63) / 64, [&](size_t band) {
+		for (size_t y = band * 64; y < std::min(out_height, band * 64 + 64); ++y) {
+			const uint8_t *top = cells + 2 * y * width;
+			const uint8_t *bottom = 2 * y + 1 < height? top + width : top;
+			uint8_t *row = out + y * out_width;
+			size_t x = 0;
+#ifdef __SSE2__
+			for (; 2 * x + 32 <= width; x += 16)
+				_mm_storeu_si128(reinterpret_cast<__m128i *>(row + x), majority16(top + 2 * x, bottom + 2 * x));
+#endif
+			for (; x < out_width; ++x) {
+				const size_t right = std::min(2 * x + 1, width - 1);
+				row[x] = majority(top[2 * x], top[right], bottom[2 * x], bottom[right]);
+			}
+		}
+	});
+}
+
+bool writePNG(const std::filesystem::path &path, size_t length, const CellReader &cells, const Palette &palette, const View &view) {
+	const ViewReader reader(length, cells, palette, view);
+	const uint8_t bits = palette.bitDepth();
+
+	if (!view.isPalette())
+		return writeParallelPNG(path, view.outputWidth(), view.outputHeight(), nullptr, [&](size_t y, uint8_t *out) { reader.averages(y, out); });
+
+	return writeParallelPNG(path, view.outputWidth(), view.outputHeight(), &palette, [&](size_t y, uint8_t *out) {
+		std::vector<uint8_t> colors(view.outputWidth());
+		reader.colors(y, colors.data());
+		packIndices(colors.data(), colors.size(), bits, out);
+	});
+}
+
+bool writeImage(const std::filesystem::path &path, size_t length, const CellReader &cells, const Palette &palette, const View &view) {
+	ImageFormat format;
+	if (!parseImageFormat(path, format)) {
+		std::cerr << std::format("Unknown image format: {}\n", path.string());
+		return false;
+	}
+
+	if (format == ImageFormat::PNG)
+		return writePNG(path, length, cells, palette, view);
+
+	static constexpr std::array LAYOUTS {PixelLayout::Gray, PixelLayout::RGB, PixelLayout::BGR, PixelLayout::RGBA};
+	const PixelLayout layout = LAYOUTS[size_t(format) - size_t(ImageFormat::PGM)];
+	const ViewReader reader(length, cells, palette, view);
+	const size_t width = view.outputWidth();
+
+	if (view.isPalette()) {
+		const ColorTable table(palette, layout);
+		return writeRawImage(path, format, width, view.outputHeight(), [&](size_t y, uint8_t *out) {
+			std::vector<uint8_t> colors(width);
+			reader.colors(y, colors.data());
+			table.expand(colors.data(), width, out);
+		});
+	}
+
+	return writeRawImage(path, format, width, view.outputHeight(), [&](size_t y, uint8_t *out) {
+		std::vector<uint8_t> rgba(4 * width);
+		reader.averages(y, rgba.data());
+		convertRGBA(rgba.data(), width, layout, out);
+	});
+}
+
+bool writeImage(const std::filesystem::path &path, const Grid<uint8_t, Coord> &grid, const Palette &palette, const View &view) {
+	const size_t length = grid.getLength();
+	const uint8_t *data = grid.getData().data();
+	return writeImage(path, length, [&](size_t row, size_t column, size_t count, uint8_t *out) {
+		std::memcpy(out, data + row * length + column, count);
+	}, palette, view);
+}
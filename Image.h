@@ -0,0 +1,138 @@
+#pragma once
+
+#include "Grid.h"
+#include "Rule.h"
+#include "Types.h"
+
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string_view>
+#include <vector>
+
+/** Maps cell colors to RGBA colors (0xRRGGBBAA). */
+class Palette {
+	private:
+		std::vector<uint32_t> colors;
+
+	public:
+		Palette() = default;
+		Palette(std::vector<uint32_t> colors_):
+			colors(std::move(colors_)) {}
+
+		/** Returns the default palette for a rule: white, red, green and blue for the first four colors, then evenly spaced
+		 *  hues for any further colors. */
+		static Palette forRule(const Rule &);
+
+		/** Parses a comma-separated list of RRGGBB or RRGGBBAA hex colors. Colors the list doesn't cover are taken from
+		 *  the rule's default palette. */
+		static bool parse(std::string_view, const Rule &, Palette &);
+
+		inline size_t size() const { return colors.size(); }
+		inline uint32_t operator[](size_t index) const { return colors[index]; }
+
+		/** Returns the smallest PNG palette bit depth (1, 2, 4 or 8) that can index every color. */
+		uint8_t bitDepth() const;
+};
+
+/** Pixel layouts that cell colors can be expanded into. */
+enum class PixelLayout {
+	/** One byte of luma per pixel. */
+	Gray,
+	RGB,
+	BGR,
+	RGBA,
+};
+
+/** Expands cell colors into pixels of one layout using per-channel lookup tables. With SSSE3 or AVX2, 16 or 32 cells
+ *  are looked up at a time with byte shuffles, one shuffle per 16 palette colors. */
+class ColorTable {
+	private:
+		PixelLayout layout;
+		size_t channels;
+		size_t colors;
+		/** tables[channel][color], with entries past the palette's end set to zero. */
+		std::array<std::array<uint8_t, 256>, 4> tables{};
+
+	public:
+		ColorTable(const Palette &, PixelLayout);
+
+		inline size_t bytesPerPixel() const { return channels; }
+
+		/** Writes count * bytesPerPixel() bytes to `out`. */
+		void expand(const uint8_t *cells, size_t count, uint8_t *out) const;
+};
+
+/** Converts cells into palette indices at the given bit depth, packed most significant bits first as PNG expects. */
+void packIndices(const uint8_t *cells, size_t count, uint8_t bits, uint8_t *out);
+
+/** Downsamples an image of cell colors by 2 in each direction, giving each output cell the most common color of its
+ *  2x2 block. Ties go to the higher color, as with Filter::Majority. Odd edges are treated as if the last row or column
+ *  were repeated. `out` must hold ceil(width/2) * ceil(height/2). */
+void halveMajority(const uint8_t *cells, size_t width, size_t height, uint8_t *out);
+
+/** How a block of cells is reduced to one pixel when downsampling. */
+enum class Filter {
+	/** The most common color in the block; ties go to the higher color. Keeps the image in the palette. */
+	Majority,
+	/** The average of the block's colors. Produces an RGBA image. */
+	Average,
+};
+
+/** The part of the grid to render and how to scale it. */
+struct View {
+	/** The top left cell in grid coordinates. The view may extend past the grid; cells outside it have color 0. */
+	int64_t left = 0;
+	int64_t top = 0;
+	size_t width = 0;
+	size_t height = 0;
+	/** Each output pixel covers scale x scale cells. */
+	size_t scale = 1;
+	Filter filter = Filter::Majority;
+
+	/** Returns a view of a whole grid of the given length at one pixel per cell. */
+	static View full(size_t length) {
+		return {0, 0, length, length};
+	}
+
+	inline size_t outputWidth() const { return (width + scale - 1) / scale; }
+	inline size_t outputHeight() const { return (height + scale - 1) / scale; }
+	inline bool isPalette() const { return scale == 1 || filter == Filter::Majority; }
+};
+
+/** Fills `out` with row `y` of an image, in whatever layout the consumer expects. May be called from several threads at
+ *  once. */
+using RowFunction = std::function<void(size_t y, uint8_t *out)>;
+
+/** Image file formats, chosen by file extension. */
+enum class ImageFormat {
+	PNG,
+	/** Binary grayscale Netpbm. */
+	PGM,
+	/** Binary RGB Netpbm. */
+	PPM,
+	/** 24-bit uncompressed Windows bitmap. */
+	BMP,
+	/** The Quite OK Image format, RGBA. */
+	QOI,
+};
+
+/** Picks the format for a path's extension (.png, .pgm, .ppm, .pnm, .bmp or .qoi, in any case). */
+bool parseImageFormat(const std::filesystem::path &, ImageFormat &);
+
+/** Copies `count` cells of row `row` starting at column `column`, which lie within a square grid, into `out`. Lets
+ *  images be rendered from cells that aren't in a Grid. May be called from several threads at once. */
+using CellReader = std::function<void(size_t row, size_t column, size_t count, uint8_t *out)>;
+
+/** Renders the view of a grid of the given length as a PNG, streaming rows to disk. Majority-filtered views are written
+ *  as palette PNGs and averaged views as RGBA PNGs. */
+bool writePNG(const std::filesystem::path &, size_t length, const CellReader &, const Palette &, const View &);
+
+/** Renders the view of a grid of the given length in the format given by the path's extension. PNG goes through
+ *  writePNG; the other formats skip compression entirely and expand cell colors straight into pixels. Only PNG and QOI
+ *  keep alpha. */
+bool writeImage(const std::filesystem::path &, size_t length, const CellReader &, const Palette &, const View &);
+
+/** Renders the view of the grid in the format given by the path's extension. */
+bool writeImage(const std::filesystem::path &, const Grid<uint8_t, Coord> &, const Palette &, const View &);
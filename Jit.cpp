@@ -0,0 +1,340 @@
+#include "Hash.h"
+#include "Jit.h"
+#include "Simulation.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <initializer_list>
+#include <random>
+#include <vector>
+
+#if defined(__x86_64__) && defined(__linux__)
+#include <sys/mman.h>
+#define LANGTON_JIT 1
+#endif
+
+namespace {
+	/** Just enough of an x86-64 encoder for the step loops: raw instruction bytes, immediates, jump targets and absolute
+	 *  addresses of places in the code, which are only known once it is mapped. */
+	class Assembler {
+		private:
+			std::vector<uint8_t> bytes;
+			std::vector<size_t> absolutes;
+
+		public:
+			inline void emit(std::initializer_list<uint8_t> code) { bytes.insert(bytes.end(), code); }
+
+			void immediate32(uint32_t value) {
+				for (size_t i = 0; i < 4; ++i)
+					bytes.push_back(uint8_t(value >> (8 * i)));
+			}
+
+			void immediate64(uint64_t value) {
+				for (size_t i = 0; i < 8; ++i)
+					bytes.push_back(uint8_t(value >> (8 * i)));
+			}
+
+			inline size_t here() const { return bytes.size(); }
+
+			/** Emits a 32-bit displacement to `target`, which has to be the end of the instruction. */
+			inline void relative(size_t target) { patch(placeholder(), target); }
+
+			/** Emits a 32-bit displacement to be filled in by patch() once its target is known. */
+			inline size_t placeholder() {
+				immediate32(0);
+				return here();
+			}
+
+			/** Points the displacement ending at `end` to `target`. */
+			void patch(size_t end, size_t target) {
+				const uint32_t displacement = uint32_t(int32_t(int64_t(target) - int64_t(end)));
+				for (size_t i = 0; i < 4; ++i)
+					bytes[end - 4 + i] = uint8_t(displacement >> (8 * i));
+			}
+
+			/** Emits the 64-bit address of `target`, relative to the start until the code is mapped. */
+			inline void absolute(size_t target) {
+				absolutes.push_back(here());
+				immediate64(target);
+			}
+
+			inline void align(size_t alignment) {
+				while (here() % alignment != 0)
+					emit({0xcc}); // int3
+			}
+
+			inline const std::vector<uint8_t> & getBytes() const { return bytes; }
+			inline const std::vector<size_t> & getAbsolutes() const { return absolutes; }
+	};
+
+	/** The epilogue both loops share: the cell pointer is in r8 and the direction in r9d. */
+	void emitReturn(Assembler &a) {
+		a.emit({0x5e});                   // pop rsi
+		a.emit({0x5f});                   // pop rdi
+		a.emit({0x4c, 0x89, 0x07});       // mov [rdi], r8
+		a.emit({0x44, 0x88, 0x0e});       // mov [rsi], r9b
+		a.emit({0xc3});                   // ret
+	}
+
+	/** Emits `void kernel(uint8_t **cell, uint8_t *direction, size_t count, const ptrdiff_t *offsets)` for the System V
+	 *  calling convention. The loop keeps the cell pointer in r8, the direction in r9d, the count in rdx, the offsets in
+	 *  r11 and the turns, two bits per color, in r10. Colors beyond the rule's own are reduced out of line. */
+	Assembler assembleBranchFree(const Rule &rule) {
+		uint64_t turns = 0;
+		for (size_t color = 0; color < rule.colors(); ++color)
+			turns |= uint64_t(rule.getTurn(uint8_t(color))) << (2 * color);
+		const uint32_t last = uint32_t(rule.colors() - 1);
+		const uint32_t wrap = rule.getNextColor(uint8_t(last));
+
+		Assembler a;
+		a.emit({0x57});                   // push rdi
+		a.emit({0x56});                   // push rsi
+		a.emit({0x4c, 0x8b, 0x07});       // mov r8, [rdi]
+		a.emit({0x44, 0x0f, 0xb6, 0x0e}); // movzx r9d, byte [rsi]
+		a.emit({0x49, 0x89, 0xcb});       // mov r11, rcx
+		a.emit({0x49, 0xba});             // mov r10, turns
+		a.immediate64(turns);
+		a.emit({0x48, 0x85, 0xd2});       // test rdx, rdx
+		a.emit({0x0f, 0x84});             // jz done
+		const size_t to_done = a.placeholder();
+
+		const size_t loop = a.here();
+		a.emit({0x41, 0x0f, 0xb6, 0x00}); // movzx eax, byte [r8]
+		a.emit({0xbe});                   // mov esi, wrap
+		a.immediate32(wrap);
+		a.emit({0x3d});                   // cmp eax, last
+		a.immediate32(last);
+		a.emit({0x0f, 0x87});             // ja foreign
+		const size_t to_foreign = a.placeholder();
+		const size_t reduced = a.here();
+		a.emit({0x8d, 0x78, 0x01});       // lea edi, [rax + 1]
+		a.emit({0x0f, 0x44, 0xfe});       // cmove edi, esi
+		a.emit({0x41, 0x88, 0x38});       // mov [r8], dil
+		a.emit({0x8d, 0x0c, 0x00});       // lea ecx, [rax + rax]
+		a.emit({0x4c, 0x89, 0xd6});       // mov rsi, r10
+		a.emit({0x48, 0xd3, 0xee});       // shr rsi, cl
+		a.emit({0x41, 0x01, 0xf1});       // add r9d, esi
+		a.emit({0x41, 0x83, 0xe1, 0x03}); // and r9d, 3
+		a.emit({0x4f, 0x03, 0x04, 0xcb}); // add r8, [r11 + r9 * 8]
+		a.emit({0x48, 0xff, 0xca});       // dec rdx
+		a.emit({0x0f, 0x85});             // jnz loop
+		a.relative(loop);
+
+		a.patch(to_done, a.here());
+		emitReturn(a);
+
+		// A color beyond the rule's own behaves like its remainder; see Rule.
+		a.patch(to_foreign, a.here());
+		a.emit({0x48, 0x8d, 0x0d});       // lea rcx, [rip + remainders]
+		const size_t to_remainders = a.placeholder();
+		a.emit({0x0f, 0xb6, 0x04, 0x01}); // movzx eax, byte [rcx + rax]
+		a.emit({0x3d});                   // cmp eax, last
+		a.immediate32(last);
+		a.emit({0xe9});                   // jmp reduced
+		a.relative(reduced);
+
+		a.patch(to_remainders, a.here());
+		for (size_t color = 0; color < 256; ++color)
+			a.emit({uint8_t(color % rule.colors())});
+		return a;
+	}
+
+	/** Emits the same function as assembleBranchFree() with one block per direction. It jumps through that direction's
+	 *  table by the cell's color to a block that paints the cell, moves and continues with the block of the new
+	 *  direction. The loop keeps the cell pointer in r8, the count in rdx and the offsets up and down in r10 and r11. */
+	Assembler assembleDispatch(const Rule &rule) {
+		Assembler a;
+		a.emit({0x57});                   // push rdi
+		a.emit({0x56});                   // push rsi
+		a.emit({0x4c, 0x8b, 0x07});       // mov r8, [rdi]
+		a.emit({0x0f, 0xb6, 0x06});       // movzx eax, byte [rsi]
+		a.emit({0x4c, 0x8b, 0x11});       // mov r10, [rcx]
+		a.emit({0x4c, 0x8b, 0x59, 0x10}); // mov r11, [rcx + 16]
+		a.emit({0x48, 0x85, 0xd2});       // test rdx, rdx
+		a.emit({0x0f, 0x84});             // jz zero
+		const size_t to_zero = a.placeholder();
+		a.emit({0x48, 0x8d, 0x0d});       // lea rcx, [rip + entries]
+		const size_t to_entries = a.placeholder();
+		a.emit({0xff, 0x24, 0xc1});       // jmp [rcx + rax * 8]
+
+		a.patch(to_zero, a.here());
+		a.emit({0x41, 0x89, 0xc1});       // mov r9d, eax
+		const size_t done = a.here();
+		emitReturn(a);
+
+		std::array<size_t, 4> bodies;
+		std::array<size_t, 4> to_tables;
+		for (size_t direction = 0; direction < 4; ++direction) {
+			bodies[direction] = a.here();
+			a.emit({0x41, 0x0f, 0xb6, 0x00}); // movzx eax, byte [r8]
+			a.emit({0x48, 0x8d, 0x0d});       // lea rcx, [rip + table]
+			to_tables[direction] = a.placeholder();
+			a.emit({0xff, 0x24, 0xc1});       // jmp [rcx + rax * 8]
+		}
+
+		std::vector<size_t> steps(4 * rule.colors());
+		for (size_t direction = 0; direction < 4; ++direction) {
+			for (size_t color = 0; color < rule.colors(); ++color) {
+				steps[direction * rule.colors() + color] = a.here();
+				const uint8_t turned = (direction + rule.getTurn(uint8_t(color))) & 3;
+				a.emit({0x41, 0xc6, 0x00, rule.getNextColor(uint8_t(color))}); // mov byte [r8], next
+				switch (turned) {
+					case 0: a.emit({0x4d, 0x01, 0xd0}); break; // add r8, r10
+					case 1: a.emit({0x49, 0xff, 0xc0}); break; // inc r8
+					case 2: a.emit({0x4d, 0x01, 0xd8}); break; // add r8, r11
+					case 3: a.emit({0x49, 0xff, 0xc8}); break; // dec r8
+				}
+				a.emit({0x48, 0xff, 0xca});       // dec rdx
+				a.emit({0x0f, 0x85});             // jnz body
+				a.relative(bodies[turned]);
+				a.emit({0x41, 0xb9});             // mov r9d, turned
+				a.immediate32(turned);
+				a.emit({0xe9});                   // jmp done
+				a.relative(done);
+			}
+		}
+
+		// Colors beyond the rule's own behave like their remainder; see Rule.
+		a.align(8);
+		a.patch(to_entries, a.here());
+		for (size_t direction = 0; direction < 4; ++direction)
+			a.absolute(bodies[direction]);
+		for (size_t direction = 0; direction < 4; ++direction) {
+			a.patch(to_tables[direction], a.here());
+			for (size_t color = 0; color < 256; ++color)
+				a.absolute(steps[direction * rule.colors() + color % rule.colors()]);
+		}
+		return a;
+	}
+}
+
+Jit::Jit(const Rule &rule) {
+#ifdef LANGTON_JIT
+	const auto install = [](const Assembler &a) {
+		Code code;
+		code.size = a.getBytes().size();
+		code.memory = ::mmap(nullptr, code.size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (code.memory == MAP_FAILED)
+			return Code();
+
+		// The pages are never writable and executable at the same time.
+		uint8_t *bytes = static_cast<uint8_t *>(code.memory);
+		std::memcpy(bytes, a.getBytes().data(), code.size);
+		for (const size_t position: a.getAbsolutes()) {
+			uint64_t address;
+			std::memcpy(&address, bytes + position, sizeof(address));
+			address += reinterpret_cast<uintptr_t>(bytes);
+			std::memcpy(bytes + position, &address, sizeof(address));
+		}
+		if (::mprotect(code.memory, code.size, PROT_READ | PROT_EXEC) == 0)
+			code.kernel = reinterpret_cast<Kernel>(code.memory);
+		return code;
+	};
+
+	if (rule.colors() <= MAX_BRANCH_FREE_COLORS)
+		loops[size_t(Loop::BranchFree)] = install(assembleBranchFree(rule));
+	loops[size_t(Loop::Dispatch)] = install(assembleDispatch(rule));
+
+	for (const Loop loop: {Loop::BranchFree, Loop::Dispatch})
+		if (isCompiled(loop) && !validate(loop, rule))
+			loops[size_t(loop)].kernel = nullptr;
+	if (!isCompiled(Loop::BranchFree))
+		preferred = Loop::Dispatch;
+#else
+	(void) rule;
+#endif
+}
+
+Jit::~Jit() {
+#ifdef LANGTON_JIT
+	for (const Code &code: loops)
+		if (code.memory)
+			::munmap(code.memory, code.size);
+#endif
+}
+
+bool Jit::validate(Loop loop, const Rule &rule) const {
+	// Random colors, some beyond the rule's own, make every turn come up. Both kernels run until the ant nears an edge
+	// or has taken enough steps.
+	constexpr size_t LENGTH = 1024;
+	constexpr size_t STEPS = size_t(1) << 20;
+	std::vector<uint8_t> compiled(LENGTH * LENGTH);
+	std::mt19937_64 random(0);
+	std::uniform_int_distribution<size_t> color(0, std::min<size_t>(2 * rule.colors() - 1, 255));
+	for (uint8_t &cell: compiled)
+		cell = uint8_t(color(random));
+	std::vector<uint8_t> table = compiled;
+
+	const ptrdiff_t offsets[4] = {-ptrdiff_t(LENGTH), 1, ptrdiff_t(LENGTH), -1};
+	uint8_t *compiled_cell = compiled.data() + (LENGTH / 2) * LENGTH + LENGTH / 2;
+	uint8_t *table_cell = table.data() + (LENGTH / 2) * LENGTH + LENGTH / 2;
+	uint8_t compiled_direction = 0;
+	uint8_t table_direction = 0;
+
+	for (size_t steps = 0; steps < STEPS;) {
+		const size_t index = compiled_cell - compiled.data();
+		const size_t room = margin(Coord(index % LENGTH), Coord(index / LENGTH), LENGTH);
+		if (room == 0)
+			break;
+		const size_t chunk = std::min(room, STEPS - steps);
+
+		run(loop, compiled_cell, compiled_direction, chunk, LENGTH);
+		for (size_t i = 0; i < chunk; ++i) {
+			const uint8_t cell = *table_cell;
+			table_direction = (table_direction + rule.getTurn(cell)) & 3;
+			*table_cell = rule.getNextColor(cell);
+			table_cell += offsets[table_direction];
+		}
+		steps += chunk;
+	}
+
+	return compiled_cell - compiled.data() == table_cell - table.data() && compiled_direction == table_direction &&
+		Hash::hash(compiled) == Hash::hash(table);
+}
+
+void Jit::run(Loop loop, uint8_t *&cell, uint8_t &direction, size_t count, size_t length) const {
+	const ptrdiff_t offsets[4] = {-ptrdiff_t(length), 1, ptrdiff_t(length), -1};
+	get(loop).kernel(&cell, &direction, count, offsets);
+}
+
+void simulateJit(Grid<uint8_t, Coord> &grid, Coord &x, Coord &y, uint8_t &direction, size_t count, const Rule &rule, Jit &jit) {
+	if (!jit.isCompiled()) {
+		simulate(grid, x, y, direction, count, rule);
+		return;
+	}
+
+	const bool can_probe = jit.isCompiled(Jit::Loop::BranchFree) && jit.isCompiled(Jit::Loop::Dispatch);
+
+	while (count != 0) {
+		const size_t length = grid.getLength();
+		const size_t room = margin(x, y, length);
+		if (room < NEAR_EDGE) {
+			const size_t checked = std::min(count, NEAR_EDGE);
+			simulate(grid, x, y, direction, checked, rule);
+			count -= checked;
+			continue;
+		}
+
+		// The first two rounds of every PROBE_EVERY time one loop each.
+		const size_t phase = jit.rounds++ % Jit::PROBE_EVERY;
+		const bool probe = can_probe && phase < 2;
+		const Jit::Loop loop = probe? Jit::Loop(phase) : jit.preferred;
+
+		const size_t chunk = std::min({count, room, Jit::ROUND});
+		uint8_t *data = grid.getData().data();
+		uint8_t *cell = data + size_t(y) * length + size_t(x);
+		const auto start = std::chrono::steady_clock::now();
+		jit.run(loop, cell, direction, chunk, length);
+		if (probe) {
+			const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+			jit.probed[phase] = elapsed.count() / chunk;
+			if (loop == Jit::Loop::Dispatch)
+				jit.preferred = jit.probed[phase] < jit.probed[size_t(Jit::Loop::BranchFree)]? Jit::Loop::Dispatch : Jit::Loop::BranchFree;
+		}
+		const size_t index = cell - data;
+		x = Coord(index % length);
+		y = Coord(index / length);
+		count -= chunk;
+	}
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "Grid.h"
+#include "Rule.h"
+#include "Types.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+/** Step loops generated at run time for one rule. The table-driven kernel looks up every color's turn and successor in
+ *  memory. The generated loops have them built in, in two ways:
+ *  - BranchFree keeps all the turns in one register and computes the next color with a compare against the last one,
+ *    so each step waits only for the cell's color and its direction's offset.
+ *  - Dispatch has a copy of the step for every direction and color and jumps to it by color. The direction and the
+ *    offset become part of the code, and the processor can run ahead along predicted jumps, which pays off for ants
+ *    in regular patterns and costs a misprediction whenever they are irregular.
+ *  Code is only generated on x86-64 Linux. Before use, each loop is checked against the table-driven kernel by hashing
+ *  the state both reach from the same start, and dropped if it differs. */
+class Jit {
+	public:
+		/** Runs `count` steps from `*cell`, which has to stay inside the grid. `offsets` holds the pointer change of a
+		 *  step in each direction. */
+		using Kernel = void (*)(uint8_t **cell, uint8_t *direction, size_t count, const ptrdiff_t *offsets);
+
+		enum class Loop: uint8_t {BranchFree, Dispatch};
+
+		/** BranchFree only handles rules whose two bits per color fit into one 64-bit register. */
+		constexpr static size_t MAX_BRANCH_FREE_COLORS = 32;
+		/** simulateJit() runs the loops in rounds of this many steps, and times one round of each whenever PROBE_EVERY
+		 *  rounds have passed to pick the one to use until then. */
+		constexpr static size_t ROUND = size_t(1) << 20;
+		constexpr static size_t PROBE_EVERY = 64;
+
+	private:
+		struct Code {
+			void *memory = nullptr;
+			size_t size = 0;
+			Kernel kernel = nullptr;
+		};
+
+		std::array<Code, 2> loops;
+		Loop preferred = Loop::BranchFree;
+		size_t rounds = 0;
+		/** Seconds per step of each loop in the last probe. */
+		std::array<double, 2> probed{};
+
+		friend void simulateJit(Grid<uint8_t, Coord> &, Coord &, Coord &, uint8_t &, size_t, const Rule &, Jit &);
+
+		inline const Code & get(Loop loop) const { return loops[size_t(loop)]; }
+
+		/** Returns whether the loop leaves the same state as the table-driven kernel. */
+		bool validate(Loop, const Rule &) const;
+
+	public:
+		explicit Jit(const Rule &);
+		~Jit();
+
+		Jit(const Jit &) = delete;
+		Jit & operator=(const Jit &) = delete;
+
+		inline bool isCompiled(Loop loop) const { return get(loop).kernel != nullptr; }
+		inline bool isCompiled() const { return isCompiled(Loop::BranchFree) || isCompiled(Loop::Dispatch); }
+
+		/** Runs `count` steps through a raw cell pointer, which must not get within `count` cells of an edge. */
+		void run(Loop, uint8_t *&cell, uint8_t &direction, size_t count, size_t length) const;
+};
+
+/** Runs `count` steps of the rule like simulate() in Simulation.h with exactly the same result, through the faster of
+ *  the compiled loops away from the edges and through the grid's checks near them. */
+void simulateJit(Grid<uint8_t, Coord> &, Coord &x, Coord &y, uint8_t &direction, size_t count, const Rule &, Jit &);
@@ -0,0 +1,113 @@
+#include "Keyframes.h"
+#include "Parallel.h"
+#include "Scheduler.h"
+#include "Simulation.h"
+#include "Util.h"
+
+#include <algorithm>
+#include <charconv>
+#include <format>
+#include <iostream>
+#include <string>
+#include <string_view>
+
+namespace Keyframes {
+	namespace {
+		constexpr std::string_view PREFIX = "keyframe_";
+		constexpr std::string_view EXTENSION = ".zst";
+
+		std::filesystem::path keyframePath(const std::filesystem::path &directory, size_t step) {
+			return directory / std::format("{}{}{}", PREFIX, step, EXTENSION);
+		}
+
+		/** Loads a keyframe's grid and ants. */
+		bool load(const std::filesystem::path &directory, size_t step, Grid<uint8_t, Coord> &grid, std::vector<Ant> &ants) {
+			const auto path = keyframePath(directory, step);
+			std::cerr << std::format("Loading keyframe {}.\n", path.string());
+			const std::string compressed = readFile(path);
+			const Checkpoint::Snapshot snapshot(std::span(reinterpret_cast<const uint8_t *>(compressed.data()), compressed.size()));
+			if (snapshot.getSteps() != step) {
+				std::cerr << std::format("Keyframe {} holds step {}\n", path.string(), snapshot.getSteps());
+				return false;
+			}
+			if (!snapshot.getAnts(ants)) {
+				std::cerr << std::format("Keyframe {} has an ant with an invalid rule\n", path.string());
+				return false;
+			}
+			snapshot.toGrid(grid);
+			return true;
+		}
+	}
+
+	Recorder::Recorder(Settings settings_, Checkpoint::Sync sync_, size_t first_step):
+		settings(std::move(settings_)),
+		sync(sync_),
+		nextStep(first_step) {
+		std::error_code error;
+		std::filesystem::create_directories(settings.directory, error);
+		if (error)
+			std::cerr << std::format("Couldn't create {}: {}\n", settings.directory.string(), error.message());
+	}
+
+	bool Recorder::capture(const Grid<uint8_t, Coord> &grid, std::span<const Ant> ants, size_t step) {
+		nextStep = nextCapture(step, settings.every, settings.perDecade);
+		const auto path = keyframePath(settings.directory, step);
+		if (!Checkpoint::write(path, Checkpoint::save(grid, ants, step), sync, 1)) {
+			std::cerr << std::format("Failed to save keyframe to {}\n", path.string());
+			return false;
+		}
+		std::cerr << std::format("Saved keyframe to {}\n", path.string());
+		return true;
+	}
+
+	std::vector<size_t> list(const std::filesystem::path &directory) {
+		std::vector<size_t> steps;
+		std::error_code error;
+		for (const auto &entry: std::filesystem::directory_iterator(directory, error)) {
+			const std::string name = entry.path().filename().string();
+			if (!name.starts_with(PREFIX) || !name.ends_with(EXTENSION))
+				continue;
+			const std::string_view digits = std::string_view(name).substr(PREFIX.size(), name.size() - PREFIX.size() - EXTENSION.size());
+			size_t step = 0;
+			const auto result = std::from_chars(digits.data(), digits.data() + digits.size(), step);
+			if (result.ec == std::errc() && result.ptr == digits.data() + digits.size())
+				steps.push_back(step);
+		}
+		std::sort(steps.begin(), steps.end());
+		return steps;
+	}
+
+	bool restore(const std::filesystem::path &directory, size_t step, Grid<uint8_t, Coord> &grid, std::vector<Ant> &ants) {
+		const std::vector<size_t> steps = list(directory);
+		if (steps.empty()) {
+			std::cerr << std::format("No keyframes in {}\n", directory.string());
+			return false;
+		}
+
+		// The last keyframe at or before `step` and the first one after it.
+		const auto later = std::upper_bound(steps.begin(), steps.end(), step);
+		const bool has_earlier = later != steps.begin();
+		const size_t earlier = has_earlier? *(later - 1) : 0;
+
+		// Reversing is tried only if it's shorter, since only the keyframe itself tells whether it's exact.
+		if (later != steps.end() && (!has_earlier || *later - step < step - earlier)) {
+			if (!load(directory, *later, grid, ants))
+				return false;
+			if (isExactlyReversible(ants)) {
+				std::cerr << std::format("Undoing {} step{}.\n", *later - step, *later - step == 1? "" : "s");
+				reverse(grid, ants, *later - step);
+				return true;
+			}
+			if (!has_earlier) {
+				std::cerr << std::format("The first keyframe is at step {} and can't be run in reverse exactly\n", *later);
+				return false;
+			}
+		}
+
+		if (!load(directory, earlier, grid, ants))
+			return false;
+		std::cerr << std::format("Processing {} step{}.\n", step - earlier, step - earlier == 1? "" : "s");
+		simulatePartitioned(grid, ants, step - earlier, threadCount());
+		return true;
+	}
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "Ant.h"
+#include "Checkpoint.h"
+#include "Grid.h"
+#include "Types.h"
+
+#include <cstddef>
+#include <filesystem>
+#include <span>
+#include <vector>
+
+/** An archive of keyframes: ordinary checkpoints of one run, written to a directory as keyframe_STEP.zst at fixed or
+ *  logarithmic intervals. The state at any step in between is rebuilt from the nearest keyframe, so a long history
+ *  costs a few checkpoints instead of thousands. */
+namespace Keyframes {
+	struct Settings {
+		/** Write a keyframe every this many steps (0 if logarithmic). */
+		size_t every = 0;
+		/** Write this many keyframes per tenfold increase in the step count (0 if linear). */
+		size_t perDecade = 0;
+		std::filesystem::path directory = "keyframes";
+
+		inline bool isEnabled() const { return every != 0 || perDecade != 0; }
+	};
+
+	/** Writes keyframes as a run passes the steps they are due at. */
+	class Recorder {
+		private:
+			Settings settings;
+			Checkpoint::Sync sync;
+			size_t nextStep;
+
+		public:
+			/** `first_step` is the total step count at which the run starts, which gets the first keyframe. */
+			Recorder(Settings, Checkpoint::Sync, size_t first_step);
+
+			/** Returns the total step count at which the next keyframe is due. */
+			inline size_t getNextStep() const { return nextStep; }
+
+			/** Writes the keyframe for total step count `step` and schedules the next one. Returns false if it
+			 *  couldn't be written. */
+			bool capture(const Grid<uint8_t, Coord> &, std::span<const Ant>, size_t step);
+	};
+
+	/** Returns the steps of the keyframes in a directory in increasing order. */
+	std::vector<size_t> list(const std::filesystem::path &directory);
+
+	/** Rebuilds the state at total step count `step` from the nearest keyframe. Earlier keyframes are run forward.
+	 *  Later ones are run in reverse if that is shorter and exact, which needs all ants to share a rule other than the
+	 *  default; see reverse() in Simulation.h. Prints an error and returns false if no keyframe can reach `step`. */
+	bool restore(const std::filesystem::path &directory, size_t step, Grid<uint8_t, Coord> &, std::vector<Ant> &);
+}
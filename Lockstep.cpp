@@ -0,0 +1,93 @@
+#include "Lockstep.h"
+#include "Simulation.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+
+namespace Lockstep {
+	namespace {
+		inline size_t margin(const Ant &ant) { return ::margin(ant.x, ant.y, ant.grid->getLength()); }
+
+		inline void step(Ant &ant) {
+			auto &color = (*ant.grid)(ant.x, ant.y);
+			ant.direction = (ant.direction + ant.rule->getTurn(color)) & 3;
+			color = ant.rule->getNextColor(color);
+			applyOffset(ant.direction, ant.x, ant.y);
+		}
+
+		void simulateGroup(std::span<Ant> ants) {
+			// Ants far from an edge are stepped through raw cell pointers, with each direction's pointer offset
+			// precomputed. Ants near one go through the grid, which expands as needed, so that one of them can't
+			// shrink the stretches of unchecked steps for everyone.
+			std::array<Ant *, LANES> fast, slow;
+			std::array<uint8_t *, LANES> cells;
+			std::array<uint8_t, LANES> directions;
+			std::array<std::array<ptrdiff_t, 4>, LANES> offsets;
+
+			for (;;) {
+				size_t fast_count = 0;
+				size_t slow_count = 0;
+				size_t chunk = SIZE_MAX;
+				for (Ant &ant: ants) {
+					if (ant.steps == 0)
+						continue;
+					const size_t room = margin(ant);
+					if (room < NEAR_EDGE) {
+						slow[slow_count++] = &ant;
+					} else {
+						fast[fast_count++] = &ant;
+						chunk = std::min(chunk, room);
+					}
+					chunk = std::min(chunk, ant.steps);
+				}
+
+				if (fast_count == 0 && slow_count == 0)
+					return;
+
+				// Ants near an edge are looked at again soon, since expanding moves them far from it.
+				if (slow_count != 0)
+					chunk = std::min(chunk, NEAR_EDGE);
+
+				for (size_t lane = 0; lane < fast_count; ++lane) {
+					Ant &ant = *fast[lane];
+					const ptrdiff_t length = ant.grid->getLength();
+					cells[lane] = ant.grid->getData().data() + ant.y * length + ant.x;
+					directions[lane] = ant.direction;
+					offsets[lane] = {-length, 1, length, -1};
+				}
+
+				for (size_t i = 0; i < chunk; ++i) {
+					for (size_t lane = 0; lane < fast_count; ++lane) {
+						const Rule &rule = *fast[lane]->rule;
+						uint8_t &cell = *cells[lane];
+						const uint8_t color = cell;
+						directions[lane] = (directions[lane] + rule.getTurn(color)) & 3;
+						cell = rule.getNextColor(color);
+						cells[lane] += offsets[lane][directions[lane]];
+					}
+
+					for (size_t lane = 0; lane < slow_count; ++lane)
+						step(*slow[lane]);
+				}
+
+				for (size_t lane = 0; lane < fast_count; ++lane) {
+					Ant &ant = *fast[lane];
+					const size_t index = cells[lane] - ant.grid->getData().data();
+					const size_t length = ant.grid->getLength();
+					ant.x = Coord(index % length);
+					ant.y = Coord(index / length);
+					ant.direction = directions[lane];
+				}
+
+				for (Ant &ant: ants)
+					ant.steps -= std::min(ant.steps, chunk);
+			}
+		}
+	}
+
+	void simulate(std::span<Ant> ants) {
+		for (size_t first = 0; first < ants.size(); first += LANES)
+			simulateGroup(ants.subspan(first, std::min(LANES, ants.size() - first)));
+	}
+}
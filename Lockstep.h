@@ -0,0 +1,31 @@
+#pragma once
+
+#include "Grid.h"
+#include "Rule.h"
+#include "Types.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+namespace Lockstep {
+	/** An independent simulation: an ant with its own grid and rule. */
+	struct Ant {
+		Grid<uint8_t, Coord> *grid = nullptr;
+		const Rule *rule = nullptr;
+		Coord x = 0;
+		Coord y = 0;
+		uint8_t direction = 0;
+		/** Steps left to run. */
+		size_t steps = 0;
+	};
+
+	/** How many ants are stepped together. A single ant's steps form one long chain of dependent loads and stores, so
+	 *  stepping several unrelated ants in turn keeps that many cache misses in flight instead of one. Beyond four, the
+	 *  ants' grids, which all have the same power-of-two layout, start to collide in the cache and throughput drops. */
+	constexpr size_t LANES = 4;
+
+	/** Runs every ant until it has no steps left, LANES ants at a time. The result for each ant is exactly what
+	 *  simulate() would have produced for it alone. */
+	void simulate(std::span<Ant>);
+}
@@ -0,0 +1,364 @@
+#include "Options.h"
+#include "Util.h"
+
+#include <algorithm>
+#include <format>
+#include <iostream>
+#include <string_view>
+#include <vector>
+
+namespace {
+	/** Parses X,Y,W,H. */
+	bool parseRectangle(std::string_view value, int64_t &x, int64_t &y, size_t &width, size_t &height) {
+		std::vector<std::string_view> parts;
+		for (size_t comma; (comma = value.find(',')) != std::string_view::npos; value.remove_prefix(comma + 1))
+			parts.push_back(value.substr(0, comma));
+		parts.push_back(value);
+		if (parts.size() != 4)
+			return false;
+		x = parseNumber<int64_t>(parts[0]);
+		y = parseNumber<int64_t>(parts[1]);
+		width = parseNumber<size_t>(parts[2]);
+		height = parseNumber<size_t>(parts[3]);
+		return true;
+	}
+
+	/** Parses X,Y,DIRECTION[,TURNS]. */
+	bool parseAnt(std::string_view value, Options::AntOption &ant) {
+		std::vector<std::string_view> parts;
+		for (size_t comma; (comma = value.find(',')) != std::string_view::npos; value.remove_prefix(comma + 1))
+			parts.push_back(value.substr(0, comma));
+		parts.push_back(value);
+		if (parts.size() != 3 && parts.size() != 4)
+			return false;
+		ant.x = parseNumber<int64_t>(parts[0]);
+		ant.y = parseNumber<int64_t>(parts[1]);
+		if (!Ant::parseDirection(parts[2], ant.direction))
+			return false;
+		if (parts.size() == 4) {
+			if (Rule rule = Rule::getDefault(); !Rule::parse(parts[3], rule))
+				return false;
+			ant.rule = parts[3];
+		}
+		return true;
+	}
+
+	[[noreturn]] void usage(const char *argv0, int status, bool render) {
+		auto &stream = status == 0? std::cout : std::cerr;
+
+		if (render) {
+			stream << std::format("Usage: {} [options] checkpoint\n\nRenders a checkpoint without simulating.\n\nOptions:\n", argv0);
+		} else {
+			stream << std::format(
+				"Usage: {} [options] [steps [checkpoint]]\n"
+				"\n"
+				"Options:\n"
+				"  --rule TURNS            the rule, 2 to 256 of L, R, U (U-turn) and N (no turn), or default (RLR\n"
+				"                          keeping 0 for unvisited cells; the default, or the checkpoint's rule)\n"
+				"  --ant X,Y,DIR[,TURNS]   add an ant at X,Y relative to the first ant's start, facing up, right, down or\n"
+				"                          left, with its own rule (default --rule's); ants step in turn\n"
+				"  --reverse               undo the given number of steps of the checkpoint instead of running more\n"
+				"  --no-highway-skip       step through highways instead of skipping along them\n"
+				"  --block-cache N         run a single ant through a cache of N 8x8 block visits\n"
+				"  --jit                   run a single ant through step loops generated for its rule (x86-64 Linux)\n"
+				"  --checkpoint-seconds N  write a checkpoint at least every N seconds (default 900, 0 disables)\n"
+				"  --checkpoint-steps N    write a checkpoint every N steps (default 0, disabled)\n"
+				"  --fsync MODE            none, file or full (default full): how checkpoints are synced before replacing\n"
+				"                          the previous one\n"
+				"  --generations N         keep the N most recent checkpoints as checkpoint, checkpoint.1, ... (default 1)\n"
+				"  --frames-every N        capture a time-lapse frame every N steps\n"
+				"  --frames-per-decade N   capture N time-lapse frames per tenfold increase in steps\n"
+				"  --frames-viewport X,Y,W,H\n"
+				"                          the region captured in frames (default -256,-256,512,512)\n"
+				"  --frames-dir DIR        write frames as DIR/frame_NNNNNN.png (default frames)\n"
+				"  --frames-pipe COMMAND   pipe raw RGBA frames into COMMAND instead of writing PNGs\n"
+				"  --keyframes-every N     write a keyframe every N steps\n"
+				"  --keyframes-per-decade N\n"
+				"                          write N keyframes per tenfold increase in steps\n"
+				"  --keyframes-dir DIR     write keyframes as DIR/keyframe_STEP.zst (default keyframes)\n"
+				"  --restore DIR           rebuild the state at the given step from the nearest keyframe in DIR instead of\n"
+				"                          running, only from earlier ones with the default rule; the checkpoint, if given,\n"
+				"                          is written but not read\n"
+				"  --heatmap BITS          count visits per cell with saturating 16 or 32 bit counters\n"
+				"  --heatmap-last          record the step of each cell's last visit\n"
+				"  --heatmap-image PATH    where to render the heatmap (default heatmap.png)\n"
+				"  --snapshot PATH         also write the image to PATH at every intermediate checkpoint\n", argv0);
+		}
+
+		stream <<
+			"  --palette LIST          comma-separated RRGGBB[AA] colors for cell colors 0, 1, ...\n"
+			"  --viewport X,Y,W,H      render only the W by H cells whose top left is X,Y relative to the ant's start\n"
+			"  --crop                  render only the bounding box of nonzero cells\n"
+			"  --scale N               render N by N cells per pixel\n"
+			"  --filter NAME           majority (default) or average: how --scale reduces cells to a pixel\n"
+			"  --output PATH           where to write the image (default langton.png); the extension picks the\n"
+			"                          format: png, pgm, ppm, bmp or qoi\n"
+			"  --pyramid BASE          write a Deep Zoom tile pyramid (BASE.dzi and BASE_files/) instead of an image\n"
+			"  --help                  show this message\n";
+		std::exit(status);
+	}
+
+	/** Parses the options that control rendering, which both programs accept. Returns false if `arg` isn't one of them. */
+	bool parseImageOption(std::string_view arg, std::string_view value, Options &options, const char *argv0, bool render) {
+		if (arg == "--palette") {
+			options.palette = value;
+		} else if (arg == "--viewport") {
+			if (!parseRectangle(value, options.viewportX, options.viewportY, options.viewportWidth, options.viewportHeight)) {
+				std::cerr << "Viewport must be X,Y,W,H\n";
+				usage(argv0, 1, render);
+			}
+			options.hasViewport = true;
+		} else if (arg == "--scale") {
+			options.scale = std::max<size_t>(1, parseNumber<size_t>(value));
+		} else if (arg == "--filter") {
+			if (value == "majority") {
+				options.filter = Filter::Majority;
+			} else if (value == "average") {
+				options.filter = Filter::Average;
+			} else {
+				std::cerr << std::format("Invalid filter: {}\n", value);
+				usage(argv0, 1, render);
+			}
+		} else if (arg == "--output" || (arg == "--snapshot" && !render)) {
+			ImageFormat format;
+			if (!parseImageFormat(value, format)) {
+				std::cerr << std::format("Unknown image format: {}\n", value);
+				usage(argv0, 1, render);
+			}
+			(arg == "--output"? options.outputPath : options.snapshotPath) = value;
+		} else if (arg == "--pyramid") {
+			options.pyramidPath = value;
+		} else {
+			return false;
+		}
+		return true;
+	}
+
+	Options parse(int argc, char **argv, bool render) {
+		Options options;
+		std::vector<std::string_view> positional;
+
+		for (int i = 1; i < argc; ++i) {
+			std::string_view arg = argv[i];
+
+			if (!arg.starts_with("--")) {
+				positional.push_back(arg);
+				continue;
+			}
+
+			if (arg == "--help")
+				usage(argv[0], 0, render);
+
+			if (arg == "--crop") {
+				options.crop = true;
+				continue;
+			}
+
+			if (arg == "--reverse" && !render) {
+				options.reverse = true;
+				continue;
+			}
+
+			if (arg == "--jit" && !render) {
+				options.jit = true;
+				continue;
+			}
+
+			if (arg == "--no-highway-skip" && !render) {
+				options.skipHighways = false;
+				continue;
+			}
+
+			if (arg == "--heatmap-last" && !render) {
+				options.heatmapLastVisit = true;
+				continue;
+			}
+
+			std::string_view value;
+			if (size_t equals = arg.find('='); equals != std::string_view::npos) {
+				value = arg.substr(equals + 1);
+				arg = arg.substr(0, equals);
+			} else if (i + 1 < argc) {
+				value = argv[++i];
+			} else {
+				std::cerr << std::format("Missing value for {}\n", arg);
+				usage(argv[0], 1, render);
+			}
+
+			if (parseImageOption(arg, value, options, argv[0], render))
+				continue;
+
+			if (render) {
+				std::cerr << std::format("Unknown option: {}\n", arg);
+				usage(argv[0], 1, render);
+			}
+
+			if (arg == "--rule") {
+				if (Rule rule = Rule::getDefault(); !Rule::parse(value, rule)) {
+					std::cerr << std::format("Invalid rule: {}\n", value);
+					usage(argv[0], 1, render);
+				}
+				options.rule = value;
+			} else if (arg == "--ant") {
+				if (!parseAnt(value, options.ants.emplace_back())) {
+					std::cerr << std::format("Ant must be X,Y,DIRECTION[,TURNS]: {}\n", value);
+					usage(argv[0], 1, render);
+				}
+			} else if (arg == "--block-cache") {
+				options.blockCache = parseNumber<size_t>(value);
+			} else if (arg == "--checkpoint-seconds") {
+				options.checkpointSeconds = parseNumber<size_t>(value);
+			} else if (arg == "--checkpoint-steps") {
+				options.checkpointSteps = parseNumber<size_t>(value);
+			} else if (arg == "--fsync") {
+				if (!Checkpoint::parseSync(value, options.sync)) {
+					std::cerr << std::format("Invalid fsync mode: {}\n", value);
+					usage(argv[0], 1, render);
+				}
+			} else if (arg == "--generations") {
+				options.generations = std::max<size_t>(1, parseNumber<size_t>(value));
+			} else if (arg == "--frames-every") {
+				options.timeLapse.every = parseNumber<size_t>(value);
+			} else if (arg == "--frames-per-decade") {
+				options.timeLapse.perDecade = parseNumber<size_t>(value);
+			} else if (arg == "--frames-viewport") {
+				auto &settings = options.timeLapse;
+				if (!parseRectangle(value, settings.x, settings.y, settings.width, settings.height)) {
+					std::cerr << "Frame viewport must be X,Y,W,H\n";
+					usage(argv[0], 1, render);
+				}
+			} else if (arg == "--frames-dir") {
+				options.timeLapse.directory = value;
+			} else if (arg == "--frames-pipe") {
+				options.timeLapse.pipe = value;
+			} else if (arg == "--keyframes-every") {
+				options.keyframes.every = parseNumber<size_t>(value);
+			} else if (arg == "--keyframes-per-decade") {
+				options.keyframes.perDecade = parseNumber<size_t>(value);
+			} else if (arg == "--keyframes-dir") {
+				options.keyframes.directory = value;
+			} else if (arg == "--restore") {
+				options.restorePath = value;
+			} else if (arg == "--heatmap") {
+				if (!Heatmap::parseCounter(value, options.heatmapCounter)) {
+					std::cerr << std::format("Invalid heatmap counter: {}\n", value);
+					usage(argv[0], 1, render);
+				}
+			} else if (arg == "--heatmap-image") {
+				options.heatmapPath = value;
+			} else {
+				std::cerr << std::format("Unknown option: {}\n", arg);
+				usage(argv[0], 1, render);
+			}
+		}
+
+		if (render) {
+			if (positional.size() != 1)
+				usage(argv[0], 1, render);
+			options.steps = 0;
+			options.checkpointPath = positional[0];
+			return options;
+		}
+
+		if (2 < positional.size())
+			usage(argv[0], 1, render);
+
+		if (1 <= positional.size())
+			options.steps = parseNumber<size_t>(positional[0]);
+
+		if (2 <= positional.size())
+			options.checkpointPath = positional[1];
+
+		return options;
+	}
+}
+
+Options parseOptions(int argc, char **argv) {
+	return parse(argc, argv, false);
+}
+
+Options parseRenderOptions(int argc, char **argv) {
+	return parse(argc, argv, true);
+}
+
+BatchOptions parseBatchOptions(int argc, char **argv) {
+	BatchOptions options;
+	std::vector<std::string_view> positional;
+
+	auto usage = [&](int status) {
+		(status == 0? std::cout : std::cerr) << std::format(
+			"Usage: {} [options] jobs\n"
+			"\n"
+			"Runs every job in the job list, one RULE STEPS [SEED] per line, where SEED is empty (the default) or\n"
+			"random:SIZE:SEED, and writes a summary of each.\n"
+			"\n"
+			"Options:\n"
+			"  --csv PATH              write CSV summaries to PATH (default standard output)\n"
+			"  --json PATH             write JSON summaries to PATH\n"
+			"  --threads N             worker threads (default one per core)\n"
+			"  --lanes N               jobs each thread runs in lockstep, 1 to {} (default {})\n"
+			"  --checkpoints DIR       write each job's final state to DIR/job_N.zst\n"
+			"  --help                  show this message\n", argv[0], Lockstep::LANES, Lockstep::LANES);
+		std::exit(status);
+	};
+
+	for (int i = 1; i < argc; ++i) {
+		std::string_view arg = argv[i];
+
+		if (!arg.starts_with("--")) {
+			positional.push_back(arg);
+			continue;
+		}
+
+		if (arg == "--help")
+			usage(0);
+
+		std::string_view value;
+		if (size_t equals = arg.find('='); equals != std::string_view::npos) {
+			value = arg.substr(equals + 1);
+			arg = arg.substr(0, equals);
+		} else if (i + 1 < argc) {
+			value = argv[++i];
+		} else {
+			std::cerr << std::format("Missing value for {}\n", arg);
+			usage(1);
+		}
+
+		if (arg == "--csv") {
+			options.csvPath = value;
+		} else if (arg == "--json") {
+			options.jsonPath = value;
+		} else if (arg == "--threads") {
+			options.threads = parseNumber<size_t>(value);
+		} else if (arg == "--lanes") {
+			options.lanes = std::clamp<size_t>(parseNumber<size_t>(value), 1, Lockstep::LANES);
+		} else if (arg == "--checkpoints") {
+			options.checkpointDirectory = value;
+		} else {
+			std::cerr << std::format("Unknown option: {}\n", arg);
+			usage(1);
+		}
+	}
+
+	if (positional.size() != 1)
+		usage(1);
+
+	options.jobsPath = positional[0];
+	return options;
+}
+
+View Options::makeView(size_t length, const std::function<Bounds()> &bounds) const {
+	View view = View::full(length);
+
+	if (crop) {
+		const Bounds box = bounds();
+		view = {int64_t(box.left), int64_t(box.top), box.width(), box.height()};
+	} else if (hasViewport) {
+		const int64_t origin = Grid<uint8_t, Coord>::getOrigin(length);
+		view = {viewportX + origin, viewportY + origin, viewportWidth, viewportHeight};
+	}
+
+	view.scale = scale;
+	view.filter = filter;
+	return view;
+}
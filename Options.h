@@ -0,0 +1,106 @@
+#pragma once
+
+#include "Checkpoint.h"
+#include "Heatmap.h"
+#include "Image.h"
+#include "Keyframes.h"
+#include "Lockstep.h"
+#include "TimeLapse.h"
+
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+
+struct Options {
+	/** Number of steps to run on top of any loaded checkpoint. */
+	size_t steps = 1'000;
+	/** Whether to undo `steps` steps of the checkpoint instead of running more. */
+	bool reverse = false;
+	/** Whether a single ant skips along highways instead of stepping through them. */
+	bool skipHighways = true;
+	/** Entries in the block cache that a single ant runs through instead, or 0 for none. */
+	size_t blockCache = 0;
+	/** Whether a single ant runs through a step loop generated for its rule. */
+	bool jit = false;
+	/** Where to load and save checkpoints. Empty if checkpoints are disabled. */
+	std::filesystem::path checkpointPath;
+	/** Minimum wall-clock time between intermediate checkpoints in seconds (0 disables). */
+	size_t checkpointSeconds = 15 * 60;
+	/** Minimum number of steps between intermediate checkpoints (0 disables). */
+	size_t checkpointSteps = 0;
+	/** How checkpoints are flushed to disk before being renamed into place. */
+	Checkpoint::Sync sync = Checkpoint::Sync::Full;
+	/** How many checkpoints to keep, including the newest one. */
+	size_t generations = 1;
+	/** The rule to run, or empty for the checkpoint's rule or else the default. */
+	std::string rule;
+	/** An extra ant from --ant: where it starts relative to the first ant's start, which way it faces and its rule
+	 *  (empty for the first ant's). */
+	struct AntOption {
+		int64_t x = 0;
+		int64_t y = 0;
+		uint8_t direction = 0;
+		std::string rule;
+	};
+	/** Extra ants for a new run, stepped after the first one in the order given. */
+	std::vector<AntOption> ants;
+	/** Comma-separated hex colors for the rendered image, overriding the rule's default palette. */
+	std::string palette;
+	/** Whether a viewport was given. Its coordinates are relative to the ant's starting cell. */
+	bool hasViewport = false;
+	int64_t viewportX = 0;
+	int64_t viewportY = 0;
+	size_t viewportWidth = 0;
+	size_t viewportHeight = 0;
+	/** Whether to render only the bounding box of nonzero cells. */
+	bool crop = false;
+	/** Each pixel of the image covers scale x scale cells. */
+	size_t scale = 1;
+	Filter filter = Filter::Majority;
+	/** Time-lapse capture, enabled if either `every` or `perDecade` is nonzero. */
+	TimeLapse::Settings timeLapse;
+	/** Keyframes written during the run, enabled if either `every` or `perDecade` is nonzero. */
+	Keyframes::Settings keyframes;
+	/** If set, the keyframe directory to rebuild the state at `steps` from instead of running. */
+	std::filesystem::path restorePath;
+	/** Visit counting for the instrumented kernel. */
+	Heatmap::Counter heatmapCounter = Heatmap::Counter::None;
+	/** Whether the instrumented kernel records each cell's last visit. */
+	bool heatmapLastVisit = false;
+	std::filesystem::path heatmapPath = "heatmap.png";
+	/** Where to write the final image. The extension picks the format. */
+	std::filesystem::path outputPath = "langton.png";
+	/** If set, the image is also written here whenever an intermediate checkpoint is due. */
+	std::filesystem::path snapshotPath;
+	/** If set, write a Deep Zoom tile pyramid with this base name instead of a single PNG. */
+	std::filesystem::path pyramidPath;
+
+	/** Returns the part of a grid of the given length to render: everything, the viewport, or the bounding box given by
+	 *  `bounds` if cropping. */
+	View makeView(size_t length, const std::function<Bounds()> &bounds) const;
+};
+
+/** Parses `langton [options] [steps [checkpoint]]`. Prints usage and exits on invalid input. */
+Options parseOptions(int argc, char **argv);
+
+/** Parses `langton-render [options] checkpoint`, which only takes the rendering options. */
+Options parseRenderOptions(int argc, char **argv);
+
+struct BatchOptions {
+	/** The job list, one `RULE STEPS [SEED]` per line. */
+	std::filesystem::path jobsPath;
+	/** Where to write the summaries. If neither is given, CSV goes to standard output. */
+	std::filesystem::path csvPath;
+	std::filesystem::path jsonPath;
+	/** Worker threads; 0 means one per core. */
+	size_t threads = 0;
+	/** How many jobs each thread runs in lockstep, from 1 to Lockstep::LANES. */
+	size_t lanes = Lockstep::LANES;
+	/** If not empty, each job's final state is written to DIR/job_N.zst. */
+	std::filesystem::path checkpointDirectory;
+};
+
+/** Parses `langton-batch [options] jobs`. Prints usage and exits on invalid input. */
+BatchOptions parseBatchOptions(int argc, char **argv);
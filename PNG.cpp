@@ -0,0 +1,283 @@
+#include "PNG.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cstring>
+#include <format>
+#include <iostream>
+
+namespace {
+	void putBigEndian(std::vector<uint8_t> &out, uint32_t value) {
+		out.insert(out.end(), {uint8_t(value >> 24), uint8_t(value >> 16), uint8_t(value >> 8), uint8_t(value)});
+	}
+
+	void endDeflate(z_stream *stream) {
+		deflateEnd(stream);
+		delete stream;
+	}
+
+	/** Strips aim for this much uncompressed data so that each is a worthwhile unit of work. */
+	constexpr size_t STRIP_BYTES = size_t(1) << 20;
+	/** The deflate window size and thus the most dictionary a strip can use. */
+	constexpr size_t WINDOW = size_t(1) << 15;
+
+	struct Strip {
+		std::vector<uint8_t> compressed;
+		uLong adler = 1;
+		size_t length = 0;
+		bool ok = true;
+	};
+
+	/** Deflates rows [first, last) as a raw deflate segment. Every segment except the last ends with a sync flush so
+	 *  that the segments can be concatenated. */
+	void compressStrip(size_t first, size_t last, size_t height, size_t row_bytes, const RowFunction &row_function, Strip &strip) {
+		const size_t scanline_size = row_bytes + 1;
+		const size_t dictionary_rows = first == 0? 0 : std::min(first, (WINDOW + scanline_size - 1) / scanline_size);
+		std::vector<uint8_t> scanlines((last - first + dictionary_rows) * scanline_size);
+
+		for (size_t y = first - dictionary_rows, i = 0; y < last; ++y, ++i) {
+			// Filter type 0 (none). Palette indices don't benefit from the predictive filters.
+			scanlines[i * scanline_size] = 0;
+			row_function(y, scanlines.data() + i * scanline_size + 1);
+		}
+
+		const size_t dictionary_bytes = std::min(WINDOW, dictionary_rows * scanline_size);
+		const size_t start = dictionary_rows * scanline_size;
+
+		auto deflater = std::unique_ptr<z_stream, void(*)(z_stream *)>(new z_stream{}, endDeflate);
+		if (deflateInit2(deflater.get(), Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 9, Z_DEFAULT_STRATEGY) != Z_OK) {
+			strip.ok = false;
+			return;
+		}
+
+		if (dictionary_bytes != 0 && deflateSetDictionary(deflater.get(), scanlines.data() + start - dictionary_bytes, dictionary_bytes) != Z_OK) {
+			strip.ok = false;
+			return;
+		}
+
+		strip.length = scanlines.size() - start;
+		strip.adler = adler32_z(1, scanlines.data() + start, strip.length);
+		strip.compressed.resize(deflateBound(deflater.get(), strip.length) + 16);
+
+		deflater->next_in = scanlines.data() + start;
+		deflater->avail_in = strip.length;
+		deflater->next_out = strip.compressed.data();
+		deflater->avail_out = strip.compressed.size();
+
+		const int result = ::deflate(deflater.get(), last == height? Z_FINISH : Z_SYNC_FLUSH);
+		if ((last == height && result != Z_STREAM_END) || (last != height && result != Z_OK) || deflater->avail_in != 0) {
+			strip.ok = false;
+			return;
+		}
+
+		strip.compressed.resize(strip.compressed.size() - deflater->avail_out);
+	}
+}
+
+PNGWriter::PNGWriter(std::filesystem::path path_, size_t width_, size_t height_, const Palette *palette):
+	path(std::move(path_)),
+	stream(path, std::ios::binary),
+	width(width_),
+	height(height_),
+	bitsPerPixel(palette? palette->bitDepth() : 32),
+	deflater(new z_stream{}, endDeflate),
+	scanline(rowBytes() + 1),
+	output(CHUNK_SIZE) {
+	if (!stream) {
+		std::cerr << std::format("Couldn't open {} for writing\n", path.string());
+		ok = false;
+		return;
+	}
+
+	if (deflateInit2(deflater.get(), Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15, 9, Z_DEFAULT_STRATEGY) != Z_OK) {
+		std::cerr << "Couldn't initialize deflate\n";
+		ok = false;
+		return;
+	}
+
+	constexpr uint8_t signature[] {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+	stream.write(reinterpret_cast<const char *>(signature), sizeof(signature));
+
+	std::vector<uint8_t> header;
+	putBigEndian(header, width);
+	putBigEndian(header, height);
+	// Bit depth, color type 3 (palette) or 6 (RGBA), compression method, filter method, no interlacing.
+	header.insert(header.end(), {palette? bitsPerPixel : uint8_t(8), uint8_t(palette? 3 : 6), 0, 0, 0});
+	writeChunk("IHDR", header.data(), header.size());
+
+	if (!palette)
+		return;
+
+	std::vector<uint8_t> colors, alphas;
+	bool has_alpha = false;
+	for (size_t i = 0; i < palette->size(); ++i) {
+		const uint32_t color = (*palette)[i];
+		colors.insert(colors.end(), {uint8_t(color >> 24), uint8_t(color >> 16), uint8_t(color >> 8)});
+		alphas.push_back(uint8_t(color));
+		has_alpha = has_alpha || uint8_t(color) != 0xff;
+	}
+
+	writeChunk("PLTE", colors.data(), colors.size());
+	if (has_alpha)
+		writeChunk("tRNS", alphas.data(), alphas.size());
+}
+
+void PNGWriter::writeChunk(const char (&type)[5], const uint8_t *data, size_t size) {
+	std::vector<uint8_t> prefix;
+	putBigEndian(prefix, size);
+	prefix.insert(prefix.end(), type, type + 4);
+
+	uLong crc = crc32(0, prefix.data() + 4, 4);
+	// crc32_z treats a null buffer as a request for the initial value, so an empty chunk must skip the call.
+	if (size != 0)
+		crc = crc32_z(crc, data, size);
+
+	stream.write(reinterpret_cast<const char *>(prefix.data()), prefix.size());
+	stream.write(reinterpret_cast<const char *>(data), size);
+
+	std::vector<uint8_t> suffix;
+	putBigEndian(suffix, crc);
+	stream.write(reinterpret_cast<const char *>(suffix.data()), suffix.size());
+
+	if (!stream) {
+		std::cerr << std::format("Couldn't write to {}\n", path.string());
+		ok = false;
+	}
+}
+
+void PNGWriter::flushOutput() {
+	if (outputUsed != 0) {
+		writeChunk("IDAT", output.data(), outputUsed);
+		outputUsed = 0;
+	}
+}
+
+bool PNGWriter::deflate(int flush) {
+	for (;;) {
+		deflater->next_out = output.data() + outputUsed;
+		deflater->avail_out = output.size() - outputUsed;
+		const int result = ::deflate(deflater.get(), flush);
+		outputUsed = output.size() - deflater->avail_out;
+
+		if (result == Z_STREAM_ERROR) {
+			std::cerr << "Deflate failed\n";
+			return ok = false;
+		}
+
+		if (outputUsed == output.size())
+			flushOutput();
+
+		if (result == Z_STREAM_END || (flush == Z_NO_FLUSH && deflater->avail_in == 0))
+			return ok;
+	}
+}
+
+bool PNGWriter::writeRow(const uint8_t *packed) {
+	if (!ok)
+		return false;
+
+	if (height <= rowsWritten || precompressed) {
+		std::cerr << std::format("Too many rows written to {}\n", path.string());
+		return ok = false;
+	}
+
+	scanline[0] = 0;
+	std::memcpy(scanline.data() + 1, packed, rowBytes());
+	deflater->next_in = scanline.data();
+	deflater->avail_in = scanline.size();
+	++rowsWritten;
+	return deflate(Z_NO_FLUSH);
+}
+
+bool PNGWriter::writeCompressed(std::span<const uint8_t> data) {
+	if (!ok)
+		return false;
+
+	if (rowsWritten != 0) {
+		std::cerr << std::format("Can't mix rows and compressed data in {}\n", path.string());
+		return ok = false;
+	}
+
+	precompressed = true;
+
+	while (!data.empty() && ok) {
+		const size_t count = std::min(data.size(), output.size() - outputUsed);
+		std::memcpy(output.data() + outputUsed, data.data(), count);
+		outputUsed += count;
+		data = data.subspan(count);
+		if (outputUsed == output.size())
+			flushOutput();
+	}
+
+	return ok;
+}
+
+bool PNGWriter::finish() {
+	if (!ok)
+		return false;
+
+	if (!precompressed) {
+		if (rowsWritten != height) {
+			std::cerr << std::format("Only {} of {} rows were written to {}\n", rowsWritten, height, path.string());
+			return ok = false;
+		}
+
+		if (!deflate(Z_FINISH))
+			return false;
+	}
+
+	flushOutput();
+	writeChunk("IEND", nullptr, 0);
+	stream.close();
+
+	if (!stream) {
+		std::cerr << std::format("Couldn't finish writing {}\n", path.string());
+		ok = false;
+	}
+
+	return ok;
+}
+
+bool writeParallelPNG(const std::filesystem::path &path, size_t width, size_t height, const Palette *palette, const RowFunction &row_function) {
+	PNGWriter writer(path, width, height, palette);
+	const size_t row_bytes = writer.rowBytes();
+	const size_t rows_per_strip = std::max<size_t>(1, STRIP_BYTES / (row_bytes + 1));
+	const size_t strip_count = (height + rows_per_strip - 1) / rows_per_strip;
+	const size_t wave = 2 * threadCount();
+
+	// CMF/FLG for a 32 KiB window at the default compression level.
+	const uint8_t zlib_header[] {0x78, 0x9c};
+	writer.writeCompressed(zlib_header);
+
+	uLong adler = 1;
+	std::vector<Strip> strips(std::min(wave, strip_count));
+
+	for (size_t first_strip = 0; first_strip < strip_count && writer; first_strip += wave) {
+		const size_t count = std::min(wave, strip_count - first_strip);
+
+		parallelFor(count, [&](size_t i) {
+			const size_t first = (first_strip + i) * rows_per_strip;
+			strips[i] = Strip{};
+			compressStrip(first, std::min(height, first + rows_per_strip), height, row_bytes, row_function, strips[i]);
+		});
+
+		for (size_t i = 0; i < count; ++i) {
+			if (!strips[i].ok) {
+				std::cerr << std::format("Couldn't compress strip {} of {}\n", first_strip + i, path.string());
+				return false;
+			}
+			writer.writeCompressed(strips[i].compressed);
+			adler = adler32_combine(adler, strips[i].adler, strips[i].length);
+		}
+	}
+
+	// An empty image still needs a terminated deflate stream.
+	if (strip_count == 0)
+		writer.writeCompressed(std::initializer_list<uint8_t>{0x03, 0x00});
+
+	std::vector<uint8_t> trailer;
+	putBigEndian(trailer, adler);
+	writer.writeCompressed(trailer);
+
+	return writer.finish();
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "Image.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include <zlib.h>
+
+/** Writes a palette or 8-bit RGBA PNG with constant memory. Image data is either given one scanline at a time with writeRow, which
+ *  deflates it as it arrives, or as an already deflated zlib stream with writeCompressed. Either way, IDAT chunks are
+ *  written out whenever the output buffer fills up. */
+class PNGWriter {
+	public:
+		/** The size of each IDAT chunk's data. */
+		constexpr static size_t CHUNK_SIZE = size_t(1) << 20;
+
+	private:
+		std::filesystem::path path;
+		std::ofstream stream;
+		size_t width;
+		size_t height;
+		size_t rowsWritten = 0;
+		uint8_t bitsPerPixel;
+		std::unique_ptr<z_stream, void(*)(z_stream *)> deflater;
+		std::vector<uint8_t> scanline;
+		std::vector<uint8_t> output;
+		size_t outputUsed = 0;
+		bool precompressed = false;
+		bool ok = true;
+
+		void writeChunk(const char (&type)[5], const uint8_t *data, size_t size);
+		void flushOutput();
+		bool deflate(int flush);
+
+	public:
+		/** Writes a palette image, or an RGBA image if `palette` is null. */
+		PNGWriter(std::filesystem::path path_, size_t width_, size_t height_, const Palette *palette);
+
+		/** Returns the number of bytes in a packed scanline, not counting the filter byte. */
+		inline size_t rowBytes() const { return (width * bitsPerPixel + 7) / 8; }
+
+		/** Appends a scanline of rowBytes() bytes: palette indices packed most significant bits first, or RGBA pixels. */
+		bool writeRow(const uint8_t *packed);
+
+		/** Appends part of a complete zlib stream (header, deflate data and Adler-32) holding all scanlines. */
+		bool writeCompressed(std::span<const uint8_t>);
+
+		/** Finishes the image data and writes the trailing chunks. Must be called after the last row. */
+		bool finish();
+
+		inline explicit operator bool() const { return ok; }
+};
+
+/** Writes a palette PNG using every core: the image is split into strips of rows that are filtered and deflated
+ *  independently, each ending on a byte boundary with a sync flush and primed with the previous strip's last 32 KiB as a
+ *  dictionary, pigz-style. The strips are concatenated into one zlib stream with a combined Adler-32. Strips are
+ *  compressed in waves, so memory use is bounded by a few strips per core. Rows are packed palette indices, or RGBA pixels if
+ *  the palette is null. */
+bool writeParallelPNG(const std::filesystem::path &, size_t width, size_t height, const Palette *, const RowFunction &);
@@ -0,0 +1,170 @@
+#include "Pack.h"
+
+#include <cstring>
+#include <iostream>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace Pack {
+	namespace {
+		void packScalar(const uint8_t *cells, size_t count, uint8_t bits, uint8_t *out) {
+			const size_t per_byte = 8 / bits;
+			for (size_t i = 0; i < count; i += per_byte) {
+				uint8_t byte = 0;
+				for (size_t j = 0; j < per_byte && i + j < count; ++j)
+					byte |= cells[i + j] << (j * bits);
+				*out++ = byte;
+			}
+		}
+
+		void unpackScalar(const uint8_t *packed, size_t count, uint8_t bits, uint8_t *out) {
+			const size_t per_byte = 8 / bits;
+			const uint8_t mask = (1 << bits) - 1;
+			for (size_t i = 0; i < count; ++i)
+				out[i] = (packed[i / per_byte] >> (i % per_byte * bits)) & mask;
+		}
+
+#ifdef __SSE2__
+		inline __m128i load(const uint8_t *pointer) {
+			return _mm_loadu_si128(reinterpret_cast<const __m128i *>(pointer));
+		}
+
+		inline void store(uint8_t *pointer, __m128i value) {
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(pointer), value);
+		}
+
+		/** Packs 128 cells into 16 bytes. */
+		inline void pack1(const uint8_t *cells, uint8_t *out) {
+			for (size_t i = 0; i < 8; ++i) {
+				const uint16_t bits = _mm_movemask_epi8(_mm_slli_epi64(load(cells + 16 * i), 7));
+				std::memcpy(out + 2 * i, &bits, sizeof(bits));
+			}
+		}
+
+		/** Packs 64 cells into 16 bytes: each dword of four cells collapses into its low byte. */
+		inline void pack2(const uint8_t *cells, uint8_t *out) {
+			__m128i dwords[4];
+			for (size_t i = 0; i < 4; ++i) {
+				const __m128i v = load(cells + 16 * i);
+				const __m128i merged = _mm_or_si128(_mm_or_si128(v, _mm_srli_epi32(v, 6)), _mm_or_si128(_mm_srli_epi32(v, 12), _mm_srli_epi32(v, 18)));
+				dwords[i] = _mm_and_si128(merged, _mm_set1_epi32(0xff));
+			}
+			store(out, _mm_packus_epi16(_mm_packs_epi32(dwords[0], dwords[1]), _mm_packs_epi32(dwords[2], dwords[3])));
+		}
+
+		/** Packs 32 cells into 16 bytes: each word of two cells collapses into its low byte. */
+		inline void pack4(const uint8_t *cells, uint8_t *out) {
+			__m128i words[2];
+			for (size_t i = 0; i < 2; ++i) {
+				const __m128i v = load(cells + 16 * i);
+				words[i] = _mm_and_si128(_mm_or_si128(v, _mm_srli_epi16(v, 4)), _mm_set1_epi16(0xff));
+			}
+			store(out, _mm_packus_epi16(words[0], words[1]));
+		}
+
+		/** Unpacks 16 bytes into 128 cells by splitting out each bit plane and interleaving the planes. */
+		inline void unpack1(const uint8_t *packed, uint8_t *out) {
+			const __m128i v = load(packed);
+			const __m128i one = _mm_set1_epi8(1);
+			__m128i planes[8];
+			for (int k = 0; k < 8; ++k)
+				planes[k] = _mm_and_si128(_mm_srl_epi16(v, _mm_cvtsi32_si128(k)), one);
+
+			for (int half = 0; half < 2; ++half) {
+				__m128i pairs[4], quads[2];
+				for (int k = 0; k < 4; ++k)
+					pairs[k] = half? _mm_unpackhi_epi8(planes[2 * k], planes[2 * k + 1]) : _mm_unpacklo_epi8(planes[2 * k], planes[2 * k + 1]);
+				for (int part = 0; part < 2; ++part) {
+					for (int k = 0; k < 2; ++k)
+						quads[k] = part? _mm_unpackhi_epi16(pairs[2 * k], pairs[2 * k + 1]) : _mm_unpacklo_epi16(pairs[2 * k], pairs[2 * k + 1]);
+					uint8_t *destination = out + 64 * half + 32 * part;
+					store(destination, _mm_unpacklo_epi32(quads[0], quads[1]));
+					store(destination + 16, _mm_unpackhi_epi32(quads[0], quads[1]));
+				}
+			}
+		}
+
+		/** Unpacks 16 bytes into 64 cells. */
+		inline void unpack2(const uint8_t *packed, uint8_t *out) {
+			const __m128i v = load(packed);
+			const __m128i mask = _mm_set1_epi8(3);
+			const __m128i t0 = _mm_and_si128(v, mask);
+			const __m128i t1 = _mm_and_si128(_mm_srli_epi16(v, 2), mask);
+			const __m128i t2 = _mm_and_si128(_mm_srli_epi16(v, 4), mask);
+			const __m128i t3 = _mm_and_si128(_mm_srli_epi16(v, 6), mask);
+			const __m128i low01 = _mm_unpacklo_epi8(t0, t1), high01 = _mm_unpackhi_epi8(t0, t1);
+			const __m128i low23 = _mm_unpacklo_epi8(t2, t3), high23 = _mm_unpackhi_epi8(t2, t3);
+			store(out, _mm_unpacklo_epi16(low01, low23));
+			store(out + 16, _mm_unpackhi_epi16(low01, low23));
+			store(out + 32, _mm_unpacklo_epi16(high01, high23));
+			store(out + 48, _mm_unpackhi_epi16(high01, high23));
+		}
+
+		/** Unpacks 16 bytes into 32 cells. */
+		inline void unpack4(const uint8_t *packed, uint8_t *out) {
+			const __m128i v = load(packed);
+			const __m128i mask = _mm_set1_epi8(0x0f);
+			const __m128i low = _mm_and_si128(v, mask);
+			const __m128i high = _mm_and_si128(_mm_srli_epi16(v, 4), mask);
+			store(out, _mm_unpacklo_epi8(low, high));
+			store(out + 16, _mm_unpackhi_epi8(low, high));
+		}
+#endif
+
+		void checkBits(uint8_t bits) {
+			if (bits != 1 && bits != 2 && bits != 4 && bits != 8) {
+				std::cerr << "Invalid number of bits per cell: " << int(bits) << '\n';
+				std::terminate();
+			}
+		}
+	}
+
+	void pack(const uint8_t *cells, size_t count, uint8_t bits, uint8_t *out) {
+		checkBits(bits);
+
+		if (bits == 8) {
+			std::memcpy(out, cells, count);
+			return;
+		}
+
+		size_t done = 0;
+#ifdef __SSE2__
+		// Each SIMD block turns 128 bits of cells into 16 bytes of output.
+		const size_t block = 128 / bits;
+		for (; done + block <= count; done += block, out += 16) {
+			if (bits == 1)
+				pack1(cells + done, out);
+			else if (bits == 2)
+				pack2(cells + done, out);
+			else
+				pack4(cells + done, out);
+		}
+#endif
+		packScalar(cells + done, count - done, bits, out);
+	}
+
+	void unpack(const uint8_t *packed, size_t count, uint8_t bits, uint8_t *out) {
+		checkBits(bits);
+
+		if (bits == 8) {
+			std::memcpy(out, packed, count);
+			return;
+		}
+
+		size_t done = 0;
+#ifdef __SSE2__
+		const size_t block = 128 / bits;
+		for (; done + block <= count; done += block, packed += 16) {
+			if (bits == 1)
+				unpack1(packed, out + done);
+			else if (bits == 2)
+				unpack2(packed, out + done);
+			else
+				unpack4(packed, out + done);
+		}
+#endif
+		unpackScalar(packed, count - done, bits, out + done);
+	}
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/** Packs cells of one byte each into 1, 2 or 4 bits per cell and back. Cell i occupies bits `(i % per_byte) * bits` of
+ *  byte `i / per_byte`. Cells must already fit in the given number of bits. */
+namespace Pack {
+	inline size_t packedSize(size_t cells, uint8_t bits) {
+		return (cells * bits + 7) / 8;
+	}
+
+	void pack(const uint8_t *cells, size_t count, uint8_t bits, uint8_t *out);
+	void unpack(const uint8_t *packed, size_t count, uint8_t bits, uint8_t *out);
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+/** Returns the number of worker threads to use for parallel loops. */
+inline size_t threadCount() {
+	return std::max<size_t>(1, std::thread::hardware_concurrency());
+}
+
+/** Calls `function(i)` for every i in [0, count) across all cores. Work is handed out one index at a time, so indices
+ *  should each represent a reasonably large piece of work (a tile, a strip of rows). */
+template <typename F>
+void parallelFor(size_t count, F &&function) {
+	const size_t workers = std::min(threadCount(), count);
+
+	if (workers <= 1) {
+		for (size_t i = 0; i < count; ++i)
+			function(i);
+		return;
+	}
+
+	std::atomic_size_t next = 0;
+	auto work = [&] {
+		for (size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < count;)
+			function(i);
+	};
+
+	std::vector<std::thread> threads;
+	threads.reserve(workers - 1);
+	for (size_t i = 1; i < workers; ++i)
+		threads.emplace_back(work);
+	work();
+	for (auto &thread: threads)
+		thread.join();
+}
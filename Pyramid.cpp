@@ -0,0 +1,94 @@
+#include "Parallel.h"
+#include "PNG.h"
+#include "Pyramid.h"
+
+#include <atomic>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <span>
+#include <vector>
+
+namespace {
+	bool writeLevel(const std::filesystem::path &directory, std::span<const uint8_t> cells, size_t length, size_t tile_size, const Palette &palette) {
+		std::error_code error;
+		std::filesystem::create_directories(directory, error);
+		if (error) {
+			std::cerr << std::format("Couldn't create {}: {}\n", directory.string(), error.message());
+			return false;
+		}
+
+		const size_t tiles_per_row = (length + tile_size - 1) / tile_size;
+		const uint8_t bits = palette.bitDepth();
+		std::atomic_bool ok = true;
+
+		parallelFor(tiles_per_row * tiles_per_row, [&](size_t tile) {
+			const size_t column = tile % tiles_per_row;
+			const size_t row = tile / tiles_per_row;
+			const size_t left = column * tile_size;
+			const size_t top = row * tile_size;
+			const size_t width = std::min(tile_size, length - left);
+			const size_t height = std::min(tile_size, length - top);
+
+			PNGWriter writer(directory / std::format("{}_{}.png", column, row), width, height, &palette);
+			std::vector<uint8_t> packed(writer.rowBytes());
+			for (size_t y = 0; y < height && writer; ++y) {
+				packIndices(cells.data() + (top + y) * length + left, width, bits, packed.data());
+				writer.writeRow(packed.data());
+			}
+
+			if (!writer.finish())
+				ok = false;
+		});
+
+		return ok;
+	}
+}
+
+bool writePyramid(const std::filesystem::path &base, const Grid<uint8_t, Coord> &grid, const Palette &palette, size_t tile_size) {
+	const size_t length = grid.getLength();
+
+	size_t max_level = 0;
+	while ((size_t(1) << max_level) < length)
+		++max_level;
+
+	std::filesystem::path dzi_path = base;
+	dzi_path += ".dzi";
+	std::filesystem::path files = base;
+	files += "_files";
+
+	std::ofstream dzi(dzi_path);
+	dzi << std::format("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+		"<Image xmlns=\"http://schemas.microsoft.com/deepzoom/2008\" Format=\"png\" Overlap=\"0\" TileSize=\"{}\">\n"
+		"  <Size Width=\"{}\" Height=\"{}\"/>\n"
+		"</Image>\n", tile_size, length, length);
+	dzi.close();
+
+	if (!dzi) {
+		std::cerr << std::format("Couldn't write {}\n", dzi_path.string());
+		return false;
+	}
+
+	// The full-resolution level reads straight from the grid. Every smaller level is derived from the one above it.
+	std::span<const uint8_t> cells = grid.getData();
+	std::vector<uint8_t> current, next;
+	size_t level_length = length;
+
+	for (size_t level = max_level + 1; level-- > 0;) {
+		std::cerr << std::format("Writing pyramid level {} ({}x{}).\n", level, level_length, level_length);
+		if (!writeLevel(files / std::to_string(level), cells, level_length, tile_size, palette))
+			return false;
+
+		if (level == 0)
+			break;
+
+		const size_t next_length = (level_length + 1) / 2;
+		next.resize(next_length * next_length);
+		halveMajority(cells.data(), level_length, level_length, next.data());
+		std::swap(current, next);
+		cells = current;
+		level_length = next_length;
+	}
+
+	return true;
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include "Grid.h"
+#include "Image.h"
+#include "Types.h"
+
+#include <filesystem>
+
+/** Writes the grid as a Deep Zoom (DZI) tile pyramid: `<base>.dzi` describes the image and `<base>_files/<level>/`
+ *  holds `<column>_<row>.png` tiles for every level, from 1x1 (level 0) up to one pixel per cell. Each level is the
+ *  previous one downsampled with halveMajority, so structure stays visible when zoomed out. */
+bool writePyramid(const std::filesystem::path &base, const Grid<uint8_t, Coord> &, const Palette &, size_t tile_size = 256);
@@ -0,0 +1,222 @@
+#include "Parallel.h"
+#include "RawImage.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace {
+	/** How many bytes are collected before being written out. */
+	constexpr size_t BUFFER_SIZE = size_t(4) << 20;
+
+	void putLittle(std::vector<uint8_t> &out, uint32_t value, size_t bytes = 4) {
+		for (size_t i = 0; i < bytes; ++i)
+			out.push_back(value >> (8 * i));
+	}
+
+	void putBig(std::vector<uint8_t> &out, uint32_t value) {
+		for (size_t i = 4; i-- > 0;)
+			out.push_back(value >> (8 * i));
+	}
+
+	/** Encodes RGBA pixels as a QOI stream, one row at a time. */
+	class QOIEncoder {
+		private:
+			std::array<uint32_t, 64> seen{};
+			uint32_t previous = 0x000000ff;
+			size_t run = 0;
+
+			static inline size_t slot(uint32_t pixel) {
+				const uint8_t r = pixel >> 24, g = pixel >> 16, b = pixel >> 8, a = pixel;
+				return (r * 3 + g * 5 + b * 7 + a * 11) % 64;
+			}
+
+		public:
+			/** Appends the encoding of `count` RGBA pixels to `out`. */
+			void encode(const uint8_t *rgba, size_t count, std::vector<uint8_t> &out) {
+				for (size_t i = 0; i < count; ++i, rgba += 4) {
+					const uint32_t pixel = uint32_t(rgba[0]) << 24 | uint32_t(rgba[1]) << 16 | uint32_t(rgba[2]) << 8 | rgba[3];
+
+					if (pixel == previous) {
+						if (++run == 62) {
+							out.push_back(0xc0 | (run - 1));
+							run = 0;
+						}
+						continue;
+					}
+
+					if (run != 0) {
+						out.push_back(0xc0 | (run - 1));
+						run = 0;
+					}
+
+					const size_t index = slot(pixel);
+					if (seen[index] == pixel) {
+						out.push_back(index);
+					} else {
+						seen[index] = pixel;
+						if ((pixel & 0xff) != (previous & 0xff)) {
+							out.push_back(0xff);
+							putBig(out, pixel);
+						} else {
+							const int8_t dr = int8_t((pixel >> 24) - (previous >> 24));
+							const int8_t dg = int8_t((pixel >> 16) - (previous >> 16));
+							const int8_t db = int8_t((pixel >> 8) - (previous >> 8));
+							const int8_t dr_dg = dr - dg;
+							const int8_t db_dg = db - dg;
+							if (-2 <= dr && dr < 2 && -2 <= dg && dg < 2 && -2 <= db && db < 2) {
+								out.push_back(0x40 | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2));
+							} else if (-32 <= dg && dg < 32 && -8 <= dr_dg && dr_dg < 8 && -8 <= db_dg && db_dg < 8) {
+								out.push_back(0x80 | (dg + 32));
+								out.push_back((dr_dg + 8) << 4 | (db_dg + 8));
+							} else {
+								out.push_back(0xfe);
+								out.push_back(pixel >> 24);
+								out.push_back(pixel >> 16);
+								out.push_back(pixel >> 8);
+							}
+						}
+					}
+
+					previous = pixel;
+				}
+			}
+
+			/** Flushes any pending run and appends the end marker. */
+			void finish(std::vector<uint8_t> &out) {
+				if (run != 0)
+					out.push_back(0xc0 | (run - 1));
+				out.insert(out.end(), {0, 0, 0, 0, 0, 0, 0, 1});
+			}
+	};
+
+	/** Returns the file header for a format, or an empty vector if the image is too large for it. */
+	std::vector<uint8_t> header(ImageFormat format, size_t width, size_t height) {
+		std::vector<uint8_t> out;
+
+		switch (format) {
+			case ImageFormat::PGM:
+			case ImageFormat::PPM: {
+				const std::string text = std::format("P{}\n{} {}\n255\n", format == ImageFormat::PGM? 5 : 6, width, height);
+				out.assign(text.begin(), text.end());
+				break;
+			}
+
+			case ImageFormat::BMP: {
+				const size_t stride = (3 * width + 3) & ~size_t(3);
+				const size_t size = 54 + stride * height;
+				if (std::numeric_limits<int32_t>::max() < width || std::numeric_limits<int32_t>::max() < height ||
+				    std::numeric_limits<uint32_t>::max() < size)
+					break;
+				out.push_back('B');
+				out.push_back('M');
+				putLittle(out, size);
+				putLittle(out, 0);
+				putLittle(out, 54);
+				putLittle(out, 40);
+				putLittle(out, width);
+				// A negative height means the rows are stored top-down.
+				putLittle(out, -int32_t(height));
+				putLittle(out, 1, 2);
+				putLittle(out, 24, 2);
+				putLittle(out, 0);
+				putLittle(out, stride * height);
+				putLittle(out, 2835);
+				putLittle(out, 2835);
+				putLittle(out, 0);
+				putLittle(out, 0);
+				break;
+			}
+
+			case ImageFormat::QOI:
+				if (std::numeric_limits<uint32_t>::max() < width || std::numeric_limits<uint32_t>::max() < height)
+					break;
+				out.insert(out.end(), {'q', 'o', 'i', 'f'});
+				putBig(out, width);
+				putBig(out, height);
+				out.push_back(4);
+				out.push_back(0);
+				break;
+
+			case ImageFormat::PNG:
+				break;
+		}
+
+		return out;
+	}
+}
+
+size_t bytesPerPixel(ImageFormat format) {
+	switch (format) {
+		case ImageFormat::PGM:
+			return 1;
+		case ImageFormat::PPM:
+		case ImageFormat::BMP:
+			return 3;
+		default:
+			return 4;
+	}
+}
+
+bool writeRawImage(const std::filesystem::path &path, ImageFormat format, size_t width, size_t height, const RowFunction &row_function) {
+	std::vector<uint8_t> buffer = header(format, width, height);
+	if (buffer.empty()) {
+		std::cerr << std::format("A {}x{} image is too large for {}\n", width, height, path.string());
+		return false;
+	}
+
+	std::ofstream stream(path, std::ios::binary);
+	if (!stream) {
+		std::cerr << std::format("Couldn't open {} for writing\n", path.string());
+		return false;
+	}
+
+	const size_t row_bytes = width * bytesPerPixel(format);
+	// BMP rows are padded to a multiple of four bytes.
+	const size_t stride = format == ImageFormat::BMP? (row_bytes + 3) & ~size_t(3) : row_bytes;
+	// Rows are produced a band at a time across all cores, in groups of rows big enough to be worth handing out.
+	const size_t band_rows = std::max<size_t>(1, BUFFER_SIZE / stride);
+	const size_t group_rows = std::max<size_t>(1, (size_t(64) << 10) / stride);
+	std::vector<uint8_t> band(std::min(band_rows, height) * stride);
+	QOIEncoder encoder;
+
+	stream.write(reinterpret_cast<const char *>(buffer.data()), buffer.size());
+	buffer.clear();
+
+	for (size_t first = 0; first < height && stream; first += band_rows) {
+		const size_t rows = std::min(band_rows, height - first);
+		parallelFor((rows + group_rows - 1) / group_rows, [&](size_t group) {
+			for (size_t row = group * group_rows; row < std::min(rows, (group + 1) * group_rows); ++row) {
+				row_function(first + row, band.data() + row * stride);
+				std::memset(band.data() + row * stride + row_bytes, 0, stride - row_bytes);
+			}
+		});
+
+		if (format == ImageFormat::QOI) {
+			encoder.encode(band.data(), rows * width, buffer);
+			stream.write(reinterpret_cast<const char *>(buffer.data()), buffer.size());
+			buffer.clear();
+		} else {
+			stream.write(reinterpret_cast<const char *>(band.data()), rows * stride);
+		}
+	}
+
+	if (format == ImageFormat::QOI)
+		encoder.finish(buffer);
+
+	stream.write(reinterpret_cast<const char *>(buffer.data()), buffer.size());
+	stream.close();
+
+	if (!stream) {
+		std::cerr << std::format("Couldn't write to {}\n", path.string());
+		return false;
+	}
+
+	return true;
+}
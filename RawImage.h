@@ -0,0 +1,14 @@
+#pragma once
+
+#include "Image.h"
+
+#include <cstddef>
+#include <filesystem>
+
+/** Returns the bytes per pixel of the rows writeRawImage expects for a format: gray for PGM, RGB for PPM, BGR for BMP
+ *  and RGBA for QOI. */
+size_t bytesPerPixel(ImageFormat);
+
+/** Writes a PGM, PPM, BMP or QOI image without any compression pass beyond QOI's own single-pass encoding. Rows are
+ *  produced in bands of a few MiB using every core, then written in order. BMP rows are stored top-down. */
+bool writeRawImage(const std::filesystem::path &, ImageFormat, size_t width, size_t height, const RowFunction &);
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+
+/** A Langton's ant rule: one turn per color, written as a string of L (left), R (right), U (U-turn) and N (no turn). The
+ *  ant turns according to the color of its cell, advances that cell to the next color (wrapping around) and moves
+ *  forward. */
+class Rule {
+	private:
+		/** The turns, or DEFAULT_NAME for the default rule. */
+		std::string name;
+		size_t colorCount = 0;
+		/** How far each color turns the ant clockwise, in quarter turns. */
+		std::array<uint8_t, 256> turns{};
+		/** The color each color advances to. */
+		std::array<uint8_t, 256> nextColors{};
+		/** The color each color advanced from, for stepping backwards. */
+		std::array<uint8_t, 256> previousColors{};
+		/** The turn of the color each color advanced from, so a step backwards can undo it without waiting for the
+		 *  previous color. */
+		std::array<uint8_t, 256> undoTurns{};
+
+		/** Fills the tables for the turns with each color advancing to the next, wrapping around. */
+		Rule(std::string name_, std::string_view turn_names):
+			name(std::move(name_)),
+			colorCount(turn_names.size()) {
+			for (size_t color = 0; color < colorCount; ++color) {
+				const char turn = turn_names[color];
+				turns[color] = turn == 'R'? 1 : turn == 'U'? 2 : turn == 'L'? 3 : 0;
+				nextColors[color] = (color + 1) % colorCount;
+				previousColors[color] = (color + colorCount - 1) % colorCount;
+			}
+			for (size_t color = 0; color < colorCount; ++color)
+				undoTurns[color] = turns[previousColors[color]];
+		}
+
+		/** Ants with different rules can share a grid, so a rule may meet colors beyond its own. It treats them as their
+		 *  remainder. */
+		void extend() {
+			for (size_t color = colorCount; color < turns.size(); ++color) {
+				turns[color] = turns[color % colorCount];
+				nextColors[color] = nextColors[color % colorCount];
+				previousColors[color] = previousColors[color % colorCount];
+				undoTurns[color] = undoTurns[color % colorCount];
+			}
+		}
+
+	public:
+		/** The name that selects the default rule. It isn't a valid string of turns, so no other rule can take it. */
+		constexpr static std::string_view DEFAULT_NAME = "default";
+
+		/** The rule implemented by simulate() in Simulation.h: color 1 turns left, every other color turns right. It is
+		 *  really RLR, with color 0 marking cells that were never visited: color 3 advances to 1, not back to 0. Unlike
+		 *  Rule("RLRR"), which cycles through all four colors. */
+		static Rule getDefault() {
+			Rule rule(std::string(DEFAULT_NAME), "RLRR");
+			// Both 0 and 3 advance to 1 and turn right, so a cell's history can't tell which one a 1 came from. Going
+			// back, it becomes 3, which behaves exactly like 0 from then on.
+			rule.nextColors[3] = 1;
+			rule.previousColors[1] = 3;
+			rule.undoTurns[1] = rule.turns[3];
+			rule.extend();
+			return rule;
+		}
+
+		/** Expects a valid string of turns; see parse(). */
+		explicit Rule(std::string name_):
+			Rule(name_, name_) {
+			extend();
+		}
+
+		/** Parses a rule of 2 to 256 turns, or DEFAULT_NAME. */
+		static bool parse(std::string_view name, Rule &rule) {
+			if (name == DEFAULT_NAME) {
+				rule = getDefault();
+				return true;
+			}
+			if (name.size() < 2 || 256 < name.size() || name.find_first_not_of("LRUN") != std::string_view::npos)
+				return false;
+			rule = Rule(std::string(name));
+			return true;
+		}
+
+		inline const std::string & getName() const { return name; }
+		inline size_t colors() const { return colorCount; }
+		inline bool isDefault() const { return name == DEFAULT_NAME; }
+		inline uint8_t getTurn(uint8_t color) const { return turns[color]; }
+		inline uint8_t getNextColor(uint8_t color) const { return nextColors[color]; }
+		inline uint8_t getPreviousColor(uint8_t color) const { return previousColors[color]; }
+		inline uint8_t getUndoTurn(uint8_t color) const { return undoTurns[color]; }
+
+		/** Returns the smallest power-of-two number of bits that can hold every color. */
+		uint8_t bitsPerCell() const {
+			if (colors() <= 2)
+				return 1;
+			if (colors() <= 4)
+				return 2;
+			if (colors() <= 16)
+				return 4;
+			return 8;
+		}
+
+		inline bool operator==(const Rule &other) const { return name == other.name; }
+};
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+
+/** Decides when to write checkpoints. The simulation runs in uninterrupted batches of at most `batchSteps` steps and only
+ *  consults the scheduler between batches, so the schedule adds nothing to the cost of the hot loop. A checkpoint is due
+ *  when either the wall-clock interval or the step interval has elapsed since the previous one (0 disables either). */
+class Scheduler {
+	public:
+		using Clock = std::chrono::steady_clock;
+
+		/** The largest number of steps run between two checks of the clock (about one second at full speed). */
+		constexpr static size_t DEFAULT_BATCH = size_t(1) << 28;
+
+	private:
+		std::chrono::seconds interval;
+		size_t stepInterval;
+		size_t batchSteps;
+		Clock::time_point lastTime = Clock::now();
+		size_t lastStep = 0;
+
+	public:
+		Scheduler(std::chrono::seconds interval_, size_t step_interval, size_t batch_steps = DEFAULT_BATCH):
+			interval(interval_),
+			stepInterval(step_interval),
+			batchSteps(std::max<size_t>(batch_steps, 1)) {}
+
+		/** Returns how many steps to run before the next check, given how many of `total` steps are done. */
+		size_t nextBatch(size_t done, size_t total) const {
+			size_t batch = std::min(batchSteps, total - done);
+			if (stepInterval != 0)
+				batch = std::min(batch, lastStep + stepInterval - done);
+			return batch;
+		}
+
+		/** Returns whether a checkpoint should be written after `done` steps. */
+		bool due(size_t done) const {
+			if (stepInterval != 0 && lastStep + stepInterval <= done)
+				return true;
+			return interval.count() != 0 && interval <= Clock::now() - lastTime;
+		}
+
+		/** Records that a checkpoint was written after `done` steps. */
+		void mark(size_t done) {
+			lastTime = Clock::now();
+			lastStep = done;
+		}
+};
+
+/** Returns the step at which the capture after one at `step` is due: `every` steps later, or so that there are
+ *  `per_decade` captures per tenfold increase in the step count. Returns the largest size_t if both are 0. */
+inline size_t nextCapture(size_t step, size_t every, size_t per_decade) {
+	if (per_decade != 0) {
+		const double factor = std::pow(10., 1. / per_decade);
+		return std::max(step + 1, size_t(std::ceil(double(step) * factor)));
+	}
+	if (every != 0)
+		return step + every;
+	return std::numeric_limits<size_t>::max();
+}
@@ -0,0 +1,182 @@
+#pragma once
+
+#include "Grid.h"
+#include "Rule.h"
+#include "Types.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <iostream>
+
+inline void applyOffset(uint8_t direction, Coord &x, Coord &y) {
+	switch (direction) {
+		case 0: --y; return;
+		case 1: ++x; return;
+		case 2: ++y; return;
+		case 3: --x; return;
+		default:
+			std::cerr << std::format("Invalid direction: {}\n", int(direction));
+			std::terminate();
+	}
+}
+
+/** Turns according to the color of the ant's cell and advances that color, following the default rule. */
+inline void turnAndPaint(uint8_t &color, uint8_t &direction) {
+	direction = (direction + 1 + ((color == 1) << 1)) & 3;
+	color = color + 1 - (color == 3) * 3;
+}
+
+/** Returns how many steps an ant at (x, y) can take without any chance of leaving a grid of the given length. */
+inline size_t margin(Coord x, Coord y, size_t length) {
+	if (x < 0 || y < 0 || length <= size_t(x) || length <= size_t(y))
+		return 0;
+	return std::min({size_t(x), size_t(y), length - 1 - size_t(x), length - 1 - size_t(y)});
+}
+
+/** Below this much room, kernels take checked steps through the grid, which move the ant away from the edge or make the
+ *  grid expand, rather than unchecked stretches too short to pay off. */
+constexpr size_t NEAR_EDGE = 64;
+
+/** Grids at least this long have rows so far apart that the rows above and below the ant are worth prefetching. */
+constexpr size_t PREFETCH_LENGTH = size_t(1) << 16;
+
+/** Runs `count` steps of the default rule through a raw cell pointer, two at a time. Each step's address normally
+ *  waits for the color loaded by the step before. Instead, the two cells the ant can reach next and the four diagonal
+ *  cells it can reach after that are loaded up front, and the colors only pick among them. Only one load in every two
+ *  steps is left on the critical path. The ant must stay more than two cells from every edge. */
+template <bool PREFETCH>
+inline void simulateLookahead(uint8_t *&cell, uint8_t &direction, size_t count, size_t length) {
+	const ptrdiff_t offsets[4] = {-ptrdiff_t(length), 1, ptrdiff_t(length), -1};
+	uint8_t color = *cell;
+
+	for (size_t i = 1; i < count; i += 2) {
+		// Color 1 turns left; every other color turns right.
+		const uint8_t right = (direction + 1) & 3;
+		const uint8_t left = (direction + 3) & 3;
+		uint8_t *right_cell = cell + offsets[right];
+		uint8_t *left_cell = cell + offsets[left];
+		const uint8_t right_color = *right_cell;
+		const uint8_t left_color = *left_cell;
+
+		// Two turns from the same direction end on the four diagonals. None of them is written by these two steps.
+		uint8_t *right_right = right_cell + offsets[(right + 1) & 3];
+		uint8_t *right_left = right_cell + offsets[direction];
+		uint8_t *left_right = left_cell + offsets[direction];
+		uint8_t *left_left = left_cell + offsets[(left + 3) & 3];
+		const uint8_t right_right_color = *right_right;
+		const uint8_t right_left_color = *right_left;
+		const uint8_t left_right_color = *left_right;
+		const uint8_t left_left_color = *left_left;
+
+		const bool first_left = color == 1;
+		turnAndPaint(color, direction);
+		*cell = color;
+		uint8_t *next = first_left? left_cell : right_cell;
+		uint8_t next_color = first_left? left_color : right_color;
+
+		const bool second_left = next_color == 1;
+		turnAndPaint(next_color, direction);
+		*next = next_color;
+		cell = first_left? (second_left? left_left : left_right) : (second_left? right_left : right_right);
+		color = first_left? (second_left? left_left_color : left_right_color) : (second_left? right_left_color : right_right_color);
+
+		if (PREFETCH) {
+			__builtin_prefetch(cell - 2 * offsets[2], 1);
+			__builtin_prefetch(cell + 2 * offsets[2], 1);
+		}
+	}
+
+	if (count % 2 != 0) {
+		turnAndPaint(*cell, direction);
+		cell += offsets[direction];
+	}
+}
+
+/** Runs `count` steps of the default rule without interruption. Away from the edges, steps go through
+ *  simulateLookahead(); near them, they go through the grid, which expands as needed. */
+inline void simulate(Grid<uint8_t, Coord> &grid, Coord &x, Coord &y, uint8_t &direction, size_t count) {
+	while (count != 0) {
+		const size_t length = grid.getLength();
+		const size_t room = margin(x, y, length);
+		if (room < NEAR_EDGE) {
+			const size_t checked = std::min(count, NEAR_EDGE);
+			for (size_t i = 0; i < checked; ++i) {
+				turnAndPaint(grid(x, y), direction);
+				applyOffset(direction, x, y);
+			}
+			count -= checked;
+			continue;
+		}
+
+		// The lookahead reads up to two cells past the ant.
+		const size_t chunk = std::min(count, room - 2);
+		uint8_t *data = grid.getData().data();
+		uint8_t *cell = data + size_t(y) * length + size_t(x);
+		if (PREFETCH_LENGTH <= length)
+			simulateLookahead<true>(cell, direction, chunk, length);
+		else
+			simulateLookahead<false>(cell, direction, chunk, length);
+		const size_t index = cell - data;
+		x = Coord(index % length);
+		y = Coord(index / length);
+		count -= chunk;
+	}
+}
+
+/** Runs `count` steps of any rule, looking up each color's turn and successor in the rule's tables. The default rule
+ *  takes the branch-free path above. */
+inline void simulate(Grid<uint8_t, Coord> &grid, Coord &x, Coord &y, uint8_t &direction, size_t count, const Rule &rule) {
+	if (rule.isDefault()) {
+		simulate(grid, x, y, direction, count);
+		return;
+	}
+
+	for (size_t i = 0; i < count; ++i) {
+		auto &color = grid(x, y);
+		direction = (direction + rule.getTurn(color)) & 3;
+		color = rule.getNextColor(color);
+		applyOffset(direction, x, y);
+	}
+}
+
+/** Undoes `count` steps of a rule straight in the grid's data: the ant moves back to the cell it came from, restores
+ *  that cell's color and turns back the way it came. Like the forward steps, the moves branch on the direction, so the
+ *  processor can predict them and start loading the next cell before the color of this one arrives. The ant must not
+ *  get within `count` cells of an edge. */
+inline void reverseUnchecked(uint8_t *data, Coord &x, Coord &y, uint8_t &direction, size_t count, size_t length, const Rule &rule) {
+	for (size_t i = 0; i < count; ++i) {
+		applyOffset((direction + 2) & 3, x, y);
+		uint8_t &cell = data[size_t(y) * length + size_t(x)];
+		const uint8_t color = cell;
+		cell = rule.getPreviousColor(color);
+		direction = (direction - rule.getUndoTurn(color)) & 3;
+	}
+}
+
+/** Undoes `count` steps of a rule. Away from the edges, steps go through reverseUnchecked(); near them, they go through
+ *  the grid, which expands as needed. As long as every cell holds one of the rule's own colors, the grid, position and
+ *  direction are exactly those `count` steps earlier. That doesn't hold for the default rule, which can't tell whether
+ *  a cell it advanced to 1 was 0 or 3 before; see isExactlyReversible() in Ant.h. */
+inline void reverse(Grid<uint8_t, Coord> &grid, Coord &x, Coord &y, uint8_t &direction, size_t count, const Rule &rule) {
+	while (count != 0) {
+		const size_t length = grid.getLength();
+		const size_t room = margin(x, y, length);
+		if (room < NEAR_EDGE) {
+			const size_t checked = std::min(count, NEAR_EDGE);
+			for (size_t i = 0; i < checked; ++i) {
+				applyOffset((direction + 2) & 3, x, y);
+				auto &color = grid(x, y);
+				direction = (direction - rule.getUndoTurn(color)) & 3;
+				color = rule.getPreviousColor(color);
+			}
+			count -= checked;
+			continue;
+		}
+
+		const size_t chunk = std::min(count, room);
+		reverseUnchecked(grid.getData().data(), x, y, direction, chunk, length, rule);
+		count -= chunk;
+	}
+}
@@ -0,0 +1,158 @@
+#include "Parallel.h"
+#include "PNG.h"
+#include "Scheduler.h"
+#include "TimeLapse.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <format>
+#include <iostream>
+#include <string_view>
+
+namespace {
+	/** Returns one past the highest frame number in the directory, so that a resumed run continues the sequence. */
+	size_t nextFrame(const std::filesystem::path &directory) {
+		constexpr std::string_view PREFIX = "frame_";
+		constexpr std::string_view EXTENSION = ".png";
+		size_t next = 0;
+		std::error_code error;
+		for (const auto &entry: std::filesystem::directory_iterator(directory, error)) {
+			const std::string name = entry.path().filename().string();
+			if (!name.starts_with(PREFIX) || !name.ends_with(EXTENSION))
+				continue;
+			const std::string_view digits = std::string_view(name).substr(PREFIX.size(), name.size() - PREFIX.size() - EXTENSION.size());
+			size_t index = 0;
+			const auto result = std::from_chars(digits.data(), digits.data() + digits.size(), index);
+			if (result.ec == std::errc() && result.ptr == digits.data() + digits.size())
+				next = std::max(next, index + 1);
+		}
+		return next;
+	}
+}
+
+TimeLapse::TimeLapse(Settings settings_, Palette palette_, size_t first_step):
+	settings(std::move(settings_)),
+	palette(std::move(palette_)),
+	rgbaTable(palette, PixelLayout::RGBA),
+	nextStep(first_step) {
+	size_t worker_count = std::max<size_t>(1, threadCount() - 1);
+
+	if (!settings.pipe.empty()) {
+		pipe = popen(settings.pipe.c_str(), "w");
+		if (!pipe) {
+			std::cerr << std::format("Couldn't start {}\n", settings.pipe);
+			ok = false;
+		}
+		// Frames have to reach the pipe in order, so only one worker can write them.
+		worker_count = 1;
+	} else {
+		std::error_code error;
+		std::filesystem::create_directories(settings.directory, error);
+		if (error) {
+			std::cerr << std::format("Couldn't create {}: {}\n", settings.directory.string(), error.message());
+			ok = false;
+		}
+		// A run that wrote earlier frames already captured the steps up to `first_step`.
+		frameCount = nextFrame(settings.directory);
+		if (frameCount != 0) {
+			std::cerr << std::format("Continuing the frames in {} at frame {}.\n", settings.directory.string(), frameCount);
+			nextStep = nextCapture(first_step, settings.every, settings.perDecade);
+		}
+	}
+
+	queueLimit = 2 * worker_count;
+	for (size_t i = 0; i < worker_count; ++i)
+		workers.emplace_back(&TimeLapse::work, this);
+}
+
+TimeLapse::~TimeLapse() {
+	finish();
+}
+
+void TimeLapse::capture(const Grid<uint8_t, Coord> &grid, size_t step) {
+	const int64_t length = grid.getLength();
+	const int64_t left = settings.x + grid.getOrigin();
+	const int64_t top = settings.y + grid.getOrigin();
+
+	Frame frame{frameCount++, std::vector<uint8_t>(settings.width * settings.height)};
+	for (size_t row = 0; row < settings.height; ++row) {
+		const int64_t y = top + int64_t(row);
+		if (y < 0 || length <= y)
+			continue;
+		const int64_t first = std::max<int64_t>(left, 0);
+		const int64_t last = std::min<int64_t>(left + settings.width, length);
+		if (first < last)
+			std::memcpy(frame.cells.data() + row * settings.width + (first - left), grid.getData().data() + y * length + first, last - first);
+	}
+
+	{
+		std::unique_lock lock(mutex);
+		queueChanged.wait(lock, [this] { return queue.size() < queueLimit; });
+		queue.push_back(std::move(frame));
+	}
+	queueChanged.notify_all();
+
+	nextStep = nextCapture(step, settings.every, settings.perDecade);
+}
+
+void TimeLapse::work() {
+	for (;;) {
+		Frame frame;
+		{
+			std::unique_lock lock(mutex);
+			queueChanged.wait(lock, [this] { return stopping || !queue.empty(); });
+			if (queue.empty())
+				return;
+			frame = std::move(queue.front());
+			queue.pop_front();
+		}
+		queueChanged.notify_all();
+		encode(frame);
+	}
+}
+
+void TimeLapse::encode(Frame &frame) {
+	if (pipe) {
+		std::vector<uint8_t> rgba(frame.cells.size() * 4);
+		rgbaTable.expand(frame.cells.data(), frame.cells.size(), rgba.data());
+		if (std::fwrite(rgba.data(), 1, rgba.size(), pipe) != rgba.size()) {
+			std::unique_lock lock(mutex);
+			ok = false;
+		}
+		return;
+	}
+
+	const auto path = settings.directory / std::format("frame_{:06}.png", frame.index);
+	PNGWriter writer(path, settings.width, settings.height, &palette);
+	std::vector<uint8_t> packed(writer.rowBytes());
+	for (size_t row = 0; row < settings.height && writer; ++row) {
+		packIndices(frame.cells.data() + row * settings.width, settings.width, palette.bitDepth(), packed.data());
+		writer.writeRow(packed.data());
+	}
+
+	if (!writer.finish()) {
+		std::unique_lock lock(mutex);
+		ok = false;
+	}
+}
+
+bool TimeLapse::finish() {
+	{
+		std::unique_lock lock(mutex);
+		stopping = true;
+	}
+	queueChanged.notify_all();
+
+	for (auto &worker: workers)
+		worker.join();
+	workers.clear();
+
+	if (pipe) {
+		if (pclose(pipe) != 0)
+			ok = false;
+		pipe = nullptr;
+	}
+
+	return ok;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "Grid.h"
+#include "Image.h"
+#include "Types.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <filesystem>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/** Captures frames of a fixed viewport during the simulation. Capturing only copies the viewport's cells into a bounded
+ *  queue; worker threads turn the copies into numbered PNGs or raw RGBA frames piped into an external encoder. If the
+ *  workers fall behind, capture blocks until the queue has room again. */
+class TimeLapse {
+	public:
+		struct Settings {
+			/** Capture every this many steps (0 if logarithmic). */
+			size_t every = 0;
+			/** Capture this many frames per tenfold increase in the step count (0 if linear). */
+			size_t perDecade = 0;
+			/** The viewport relative to the ant's starting cell. */
+			int64_t x = -256;
+			int64_t y = -256;
+			size_t width = 512;
+			size_t height = 512;
+			/** Directory for frame_NNNNNN.png files. Ignored if `pipe` is set. */
+			std::filesystem::path directory = "frames";
+			/** A command that receives raw RGBA frames on its standard input, e.g. ffmpeg -f rawvideo -pix_fmt rgba ... */
+			std::string pipe;
+		};
+
+		constexpr static size_t NONE = std::numeric_limits<size_t>::max();
+
+	private:
+		struct Frame {
+			size_t index;
+			std::vector<uint8_t> cells;
+		};
+
+		Settings settings;
+		Palette palette;
+		/** Expands frames into RGBA for the pipe. */
+		ColorTable rgbaTable;
+		size_t nextStep;
+		size_t frameCount = 0;
+		size_t queueLimit;
+		std::deque<Frame> queue;
+		std::mutex mutex;
+		std::condition_variable queueChanged;
+		std::vector<std::thread> workers;
+		FILE *pipe = nullptr;
+		bool stopping = false;
+		bool ok = true;
+
+		void work();
+		void encode(Frame &);
+
+	public:
+		/** `first_step` is the total step count at which the run starts. */
+		TimeLapse(Settings, Palette, size_t first_step);
+		~TimeLapse();
+
+		TimeLapse(const TimeLapse &) = delete;
+		TimeLapse & operator=(const TimeLapse &) = delete;
+
+		/** Returns the total step count at which the next frame is due. */
+		inline size_t getNextStep() const { return nextStep; }
+
+		/** Snapshots the viewport as of total step count `step` and schedules the next frame. */
+		void capture(const Grid<uint8_t, Coord> &, size_t step);
+
+		/** Waits for every queued frame to be encoded. Returns false if any frame failed. */
+		bool finish();
+};
@@ -0,0 +1,5 @@
+#pragma once
+
+#include <cstdint>
+
+using Coord = int32_t;
@@ -10,17 +10,16 @@ std::string readFile(const std::filesystem::path &path) {
 	}
 	std::ifstream stream;
 	stream.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-	stream.open(path);
+	stream.open(path, std::ios::binary);
 	stream.exceptions(std::ifstream::goodbit);
 	if (!stream.is_open()) {
 		std::cerr << "Couldn't open file for reading\n";
 		std::terminate();
 	}
 	stream.seekg(0, std::ios::end);
-	std::string out;
-	out.reserve(stream.tellg());
+	std::string out(size_t(stream.tellg()), '\0');
 	stream.seekg(0, std::ios::beg);
-	out.assign(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+	stream.read(out.data(), out.size());
 	stream.close();
 	return out;
 }
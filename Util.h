@@ -1,4 +1,22 @@
+#pragma once
+
+#include <charconv>
+#include <concepts>
 #include <filesystem>
+#include <format>
+#include <iostream>
 #include <string>
+#include <string_view>
 
 std::string readFile(const std::filesystem::path &);
+
+template <std::integral I>
+I parseNumber(std::string_view view, int base = 10) {
+	I out{};
+	auto result = std::from_chars(view.begin(), view.end(), out, base);
+	if (result.ec == std::errc::invalid_argument) {
+		std::cerr << std::format("Not an integer: \"{}\"\n", view);
+		std::terminate();
+	}
+	return out;
+}
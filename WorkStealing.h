@@ -0,0 +1,86 @@
+#pragma once
+
+#include "Parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/** Calls `function(worker, task)` for every task in [0, count) on `workers` threads. Each worker starts with a
+ *  contiguous share of the tasks in its own deque and takes them from the front; a worker that runs dry steals from the
+ *  back of the fullest other deque. Tasks of wildly different sizes thus balance without every task going through one
+ *  shared queue. `worker` is in [0, workers), so callers can keep per-worker state such as scratch memory. */
+template <typename F>
+void parallelSteal(size_t count, F &&function, size_t workers = threadCount()) {
+	workers = std::max<size_t>(1, std::min(workers, count));
+
+	struct Queue {
+		std::mutex mutex;
+		std::deque<size_t> tasks;
+	};
+
+	std::vector<Queue> queues(workers);
+	for (size_t worker = 0; worker < workers; ++worker)
+		for (size_t task = worker * count / workers; task < (worker + 1) * count / workers; ++task)
+			queues[worker].tasks.push_back(task);
+
+	// Tasks that haven't been taken yet. Once it reaches zero, idle workers can stop looking.
+	std::atomic_size_t remaining = count;
+
+	auto take = [&](size_t worker, size_t &task) {
+		{
+			Queue &own = queues[worker];
+			std::lock_guard lock(own.mutex);
+			if (!own.tasks.empty()) {
+				task = own.tasks.front();
+				own.tasks.pop_front();
+				return true;
+			}
+		}
+
+		while (remaining.load(std::memory_order_relaxed) != 0) {
+			size_t victim = worker;
+			size_t most = 0;
+			for (size_t other = 0; other < workers; ++other) {
+				if (other == worker)
+					continue;
+				std::lock_guard lock(queues[other].mutex);
+				if (most < queues[other].tasks.size()) {
+					most = queues[other].tasks.size();
+					victim = other;
+				}
+			}
+
+			if (victim == worker)
+				return false;
+
+			std::lock_guard lock(queues[victim].mutex);
+			if (!queues[victim].tasks.empty()) {
+				task = queues[victim].tasks.back();
+				queues[victim].tasks.pop_back();
+				return true;
+			}
+		}
+
+		return false;
+	};
+
+	auto work = [&](size_t worker) {
+		for (size_t task; take(worker, task);) {
+			remaining.fetch_sub(1, std::memory_order_relaxed);
+			function(worker, task);
+		}
+	};
+
+	std::vector<std::thread> threads;
+	threads.reserve(workers - 1);
+	for (size_t worker = 1; worker < workers; ++worker)
+		threads.emplace_back(work, worker);
+	work(0);
+	for (auto &thread: threads)
+		thread.join();
+}
@@ -1,6 +1,8 @@
+#include "Parallel.h"
 #include "Zstd.h"
 
-#include <bit>
+#include <algorithm>
+#include <atomic>
 #include <cstring>
 #include <iostream>
 #include <memory>
@@ -8,33 +10,77 @@
 #include <zstd.h>
 
 namespace Zstd {
-	std::vector<uint8_t> decompress(std::span<const uint8_t> span) {
-		const size_t out_size = ZSTD_DStreamOutSize();
-		std::vector<uint8_t> out_buffer(out_size);
-		std::vector<uint8_t> out;
+	namespace {
+		std::vector<uint8_t> decompressStream(std::span<const uint8_t> span) {
+			const size_t out_size = ZSTD_DStreamOutSize();
+			std::vector<uint8_t> out_buffer(out_size);
+			std::vector<uint8_t> out;
 
-		auto context = std::unique_ptr<ZSTD_DCtx, size_t(*)(ZSTD_DCtx *)>(ZSTD_createDCtx(), ZSTD_freeDCtx);
-		auto stream  = std::unique_ptr<ZSTD_DStream, size_t(*)(ZSTD_DStream *)>(ZSTD_createDStream(), ZSTD_freeDStream);
+			auto stream = std::unique_ptr<ZSTD_DStream, size_t(*)(ZSTD_DStream *)>(ZSTD_createDStream(), ZSTD_freeDStream);
 
-		ZSTD_inBuffer input {span.data(), span.size_bytes(), 0};
+			ZSTD_inBuffer input {span.data(), span.size_bytes(), 0};
 
-		size_t last_result = 0;
+			size_t last_result = 0;
 
-		while (input.pos < input.size) {
-			ZSTD_outBuffer output {&out_buffer[0], out_size, 0};
-			const size_t result = ZSTD_decompressStream(stream.get(), &output, &input);
-			if (ZSTD_isError(result)) {
-				std::cerr << "Couldn't decompress\n";
+			while (input.pos < input.size) {
+				ZSTD_outBuffer output {&out_buffer[0], out_size, 0};
+				const size_t result = ZSTD_decompressStream(stream.get(), &output, &input);
+				if (ZSTD_isError(result)) {
+					std::cerr << "Couldn't decompress\n";
+					std::terminate();
+				}
+				last_result = result;
+
+				const uint8_t *raw_bytes = out_buffer.data();
+				out.insert(out.end(), raw_bytes, raw_bytes + output.pos / sizeof(uint8_t));
+			}
+
+			if (last_result != 0) {
+				std::cerr << "Reached end of tile input without finishing decompression\n";
 				std::terminate();
 			}
-			last_result = result;
 
-			const uint8_t *raw_bytes = out_buffer.data();
-			out.insert(out.end(), raw_bytes, raw_bytes + output.pos / sizeof(uint8_t));
+			return out;
+		}
+
+		struct Frame {
+			std::span<const uint8_t> compressed;
+			size_t offset;
+			size_t size;
+		};
+	}
+
+	std::vector<uint8_t> decompress(std::span<const uint8_t> span) {
+		std::vector<Frame> frames;
+		size_t total = 0;
+
+		for (auto rest = span; !rest.empty();) {
+			const size_t frame_size = ZSTD_findFrameCompressedSize(rest.data(), rest.size());
+			if (ZSTD_isError(frame_size)) {
+				std::cerr << "Couldn't find the end of a compressed frame\n";
+				std::terminate();
+			}
+			const auto content_size = ZSTD_getFrameContentSize(rest.data(), rest.size());
+			if (content_size == ZSTD_CONTENTSIZE_UNKNOWN || content_size == ZSTD_CONTENTSIZE_ERROR)
+				return decompressStream(span);
+			frames.push_back({rest.first(frame_size), total, size_t(content_size)});
+			total += content_size;
+			rest = rest.subspan(frame_size);
 		}
 
-		if (last_result != 0) {
-			std::cerr << "Reached end of tile input without finishing decompression\n";
+		std::vector<uint8_t> out(total);
+		std::atomic_bool ok = true;
+
+		parallelFor(frames.size(), [&](size_t index) {
+			const Frame &frame = frames[index];
+			auto context = std::unique_ptr<ZSTD_DCtx, size_t(*)(ZSTD_DCtx *)>(ZSTD_createDCtx(), ZSTD_freeDCtx);
+			const size_t result = ZSTD_decompressDCtx(context.get(), out.data() + frame.offset, frame.size, frame.compressed.data(), frame.compressed.size());
+			if (ZSTD_isError(result) || result != frame.size)
+				ok = false;
+		});
+
+		if (!ok) {
+			std::cerr << "Couldn't decompress\n";
 			std::terminate();
 		}
 
@@ -42,14 +88,37 @@ namespace Zstd {
 	}
 
 	std::vector<uint8_t> compress(std::span<const uint8_t> span) {
-		const auto buffer_size = ZSTD_compressBound(span.size_bytes());
-		auto buffer = std::vector<uint8_t>(buffer_size);
-		auto result = ZSTD_compress(&buffer[0], buffer_size, span.data(), span.size_bytes(), ZSTD_defaultCLevel());
-		if (ZSTD_isError(result)) {
+		const size_t frame_count = std::max<size_t>(1, (span.size() + FRAME_SIZE - 1) / FRAME_SIZE);
+		std::vector<std::vector<uint8_t>> frames(frame_count);
+		std::atomic_bool ok = true;
+
+		parallelFor(frame_count, [&](size_t index) {
+			const auto input = span.subspan(index * FRAME_SIZE, std::min(FRAME_SIZE, span.size() - index * FRAME_SIZE));
+			auto &buffer = frames[index];
+			buffer.resize(ZSTD_compressBound(input.size()));
+			const auto result = ZSTD_compress(buffer.data(), buffer.size(), input.data(), input.size(), ZSTD_defaultCLevel());
+			if (ZSTD_isError(result)) {
+				ok = false;
+				return;
+			}
+			buffer.resize(result);
+		});
+
+		if (!ok) {
 			std::cerr << "Couldn't compress data\n";
 			std::terminate();
 		}
-		buffer.resize(result);
-		return buffer;
+
+		if (frame_count == 1)
+			return std::move(frames[0]);
+
+		std::vector<uint8_t> out;
+		size_t total = 0;
+		for (const auto &frame: frames)
+			total += frame.size();
+		out.reserve(total);
+		for (const auto &frame: frames)
+			out.insert(out.end(), frame.begin(), frame.end());
+		return out;
 	}
 }
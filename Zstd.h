@@ -5,6 +5,14 @@
 #include <vector>
 
 namespace Zstd {
+	/** Decompresses one or more concatenated frames. If every frame records its content size, frames are decompressed in
+	 *  parallel straight into an output buffer of the right size; otherwise they're streamed. */
 	std::vector<uint8_t> decompress(std::span<const uint8_t>);
+
+	/** Compresses data as a sequence of independent frames of at most FRAME_SIZE input bytes each, compressed in
+	 *  parallel. The result is still an ordinary zstd stream that any decoder reads as a whole. */
 	std::vector<uint8_t> compress(std::span<const uint8_t>);
+
+	/** Input bytes per frame. Large enough that splitting costs little compression ratio. */
+	constexpr size_t FRAME_SIZE = size_t(32) << 20;
 }
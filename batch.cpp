@@ -0,0 +1,126 @@
+#include "Batch.h"
+#include "Checkpoint.h"
+#include "Lockstep.h"
+#include "Options.h"
+#include "Parallel.h"
+#include "Util.h"
+#include "WorkStealing.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <span>
+#include <vector>
+
+int main(int argc, char **argv) {
+	const BatchOptions options = parseBatchOptions(argc, argv);
+
+	if (!std::filesystem::exists(options.jobsPath)) {
+		std::cerr << std::format("Couldn't find job list {}.\n", options.jobsPath.string());
+		return 1;
+	}
+
+	std::vector<Batch::Job> jobs;
+	if (!Batch::parseJobs(readFile(options.jobsPath), jobs))
+		return 1;
+
+	const size_t lanes = options.lanes;
+	const size_t groups = (jobs.size() + lanes - 1) / lanes;
+	const size_t workers = std::min(options.threads == 0? threadCount() : options.threads, std::max<size_t>(groups, 1));
+	std::cerr << std::format("Running {} job{} on {} thread{}.\n", jobs.size(), jobs.size() == 1? "" : "s", workers, workers == 1? "" : "s");
+
+	if (!options.checkpointDirectory.empty()) {
+		std::error_code error;
+		std::filesystem::create_directories(options.checkpointDirectory, error);
+		if (error) {
+			std::cerr << std::format("Couldn't create {}: {}\n", options.checkpointDirectory.string(), error.message());
+			return 1;
+		}
+	}
+
+	// Jobs run in groups of similar length, so that ants in lockstep finish at about the same time.
+	std::vector<size_t> order(jobs.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return jobs[a].steps < jobs[b].steps; });
+
+	std::vector<Batch::Summary> summaries(jobs.size());
+	std::vector<std::vector<Batch::Arena>> arenas(workers, std::vector<Batch::Arena>(lanes));
+	std::atomic_bool failed = false;
+	const auto start = std::chrono::steady_clock::now();
+
+	parallelSteal(groups, [&](size_t worker, size_t group) {
+		const std::span<const size_t> members = std::span(order).subspan(group * lanes, std::min(lanes, jobs.size() - group * lanes));
+		std::vector<Batch::Arena> &own = arenas[worker];
+
+		if (members.size() == 1) {
+			summaries[members[0]] = own[0].run(jobs[members[0]]);
+		} else {
+			std::array<Lockstep::Ant, Lockstep::LANES> ants;
+			for (size_t lane = 0; lane < members.size(); ++lane)
+				ants[lane] = own[lane].start(jobs[members[lane]]);
+
+			const auto group_start = std::chrono::steady_clock::now();
+			Lockstep::simulate(std::span(ants).first(members.size()));
+			const std::chrono::duration<double> group_elapsed = std::chrono::steady_clock::now() - group_start;
+
+			for (size_t lane = 0; lane < members.size(); ++lane)
+				summaries[members[lane]] = own[lane].finish(jobs[members[lane]], ants[lane], group_elapsed.count());
+		}
+
+		uint64_t group_steps = 0;
+		for (const size_t member: members)
+			group_steps += jobs[member].steps;
+		for (const size_t member: members) {
+			summaries[member].group = group;
+			summaries[member].groupSteps = group_steps;
+		}
+
+		if (options.checkpointDirectory.empty())
+			return;
+
+		for (size_t lane = 0; lane < members.size(); ++lane) {
+			const std::filesystem::path path = options.checkpointDirectory / std::format("job_{}.zst", members[lane]);
+			if (!Checkpoint::write(path, own[lane].save(jobs[members[lane]]), Checkpoint::Sync::None, 1)) {
+				std::cerr << std::format("Failed to save checkpoint to {}\n", path.string());
+				failed = true;
+			}
+		}
+	}, workers);
+
+	const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	size_t total_steps = 0;
+	for (const auto &job: jobs)
+		total_steps += job.steps;
+	std::cerr << std::format("Ran {} steps in {:.3f} s ({:.2f} million steps per second).\n", total_steps, elapsed.count(),
+		elapsed.count() == 0? 0. : total_steps / elapsed.count() / 1e6);
+
+	if (failed)
+		return 1;
+
+	if (!options.jsonPath.empty()) {
+		std::ofstream stream(options.jsonPath);
+		Batch::writeJSON(stream, jobs, summaries);
+		if (!stream) {
+			std::cerr << std::format("Failed to write to {}\n", options.jsonPath.string());
+			return 1;
+		}
+	}
+
+	if (!options.csvPath.empty()) {
+		std::ofstream stream(options.csvPath);
+		Batch::writeCSV(stream, jobs, summaries);
+		if (!stream) {
+			std::cerr << std::format("Failed to write to {}\n", options.csvPath.string());
+			return 1;
+		}
+	} else if (options.jsonPath.empty()) {
+		Batch::writeCSV(std::cout, jobs, summaries);
+	}
+}
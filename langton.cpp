@@ -1,13 +1,28 @@
-#include "lodepng.h"
+#include "Ant.h"
+#include "BlockCache.h"
+#include "Checkpoint.h"
 #include "Grid.h"
+#include "Hash.h"
+#include "Heatmap.h"
+#include "Highway.h"
+#include "Image.h"
+#include "Jit.h"
+#include "Keyframes.h"
+#include "Options.h"
+#include "Parallel.h"
+#include "Pyramid.h"
+#include "Rule.h"
+#include "Scheduler.h"
+#include "Simulation.h"
+#include "TimeLapse.h"
+#include "Types.h"
 #include "Util.h"
-#include "Zstd.h"
 
-#include <charconv>
+#include <algorithm>
+#include <chrono>
 #include <cstdint>
 #include <cstring>
 #include <filesystem>
-#include <fstream>
 #include <format>
 #include <iostream>
 #include <memory>
@@ -15,196 +30,292 @@
 #include <string>
 #include <vector>
 
-using Coord = int32_t;
+int main(int argc, char **argv) {
+	const Options options = parseOptions(argc, argv);
+	// Restoring from keyframes lands exactly on the requested step, so nothing is left to run.
+	const size_t steps = options.restorePath.empty()? options.steps : 0;
+	const std::filesystem::path &checkpoint_path = options.checkpointPath;
 
-template <std::integral I>
-I parseNumber(std::string_view view, int base = 10) {
-	I out{};
-	auto result = std::from_chars(view.begin(), view.end(), out, base);
-	if (result.ec == std::errc::invalid_argument) {
-		std::cerr << std::format("Not an integer: \"{}\"\n", view);
-		std::terminate();
-	}
-	return out;
-}
+	Grid<uint8_t, Coord> grid(1);
+	std::vector<Ant> ants(1);
+	size_t previous_steps = 0;
 
-inline void applyOffset(uint8_t direction, Coord &x, Coord &y) {
-	switch (direction) {
-		case 0: --y; return;
-		case 1: ++x; return;
-		case 2: ++y; return;
-		case 3: --x; return;
-		default:
-			std::cerr << std::format("Invalid direction: {}\n", int(direction));
-			std::terminate();
+	std::unique_ptr<Checkpoint::Snapshot> snapshot;
+
+	if (!options.restorePath.empty()) {
+		if (!options.rule.empty() || !options.ants.empty() || options.reverse || options.heatmapCounter != Heatmap::Counter::None ||
+		    options.heatmapLastVisit) {
+			std::cerr << "--restore can't be combined with --rule, --ant, --reverse or the heatmap\n";
+			return 1;
+		}
+		if (!Keyframes::restore(options.restorePath, options.steps, grid, ants))
+			return 1;
+		previous_steps = options.steps;
+		std::cerr << std::format("Restored step {}. Grid length is {}.\n", previous_steps, grid.getLength());
+	} else if (!checkpoint_path.empty()) {
+		if (std::filesystem::exists(checkpoint_path)) {
+			std::cerr << std::format("Loading steps from {}.\n", checkpoint_path.string());
+			std::string compressed = readFile(checkpoint_path);
+			snapshot = std::make_unique<Checkpoint::Snapshot>(std::span(reinterpret_cast<const uint8_t *>(compressed.data()), compressed.size()));
+			snapshot->toGrid(grid);
+			if (!snapshot->getAnts(ants)) {
+				std::cerr << "Checkpoint has an ant with an invalid rule\n";
+				return 1;
+			}
+			previous_steps = snapshot->getSteps();
+			std::cerr << std::format("Loaded {} step{}. Grid length is {}.\n", previous_steps, previous_steps == 1? "" : "s", grid.getLength());
+		} else {
+			std::cerr << std::format("Couldn't find checkpoint {}.\n", checkpoint_path.string());
+		}
 	}
-}
 
-std::vector<uint8_t> save(const Grid<uint8_t, Coord> &grid, int32_t x, int32_t y, uint8_t direction, size_t steps) {
-	const size_t grid_length = grid.getLength();
+	// A checkpoint keeps its ants and their rules. Checkpoints from before rules were stored used the default rule.
+	if (!options.rule.empty()) {
+		if (snapshot && options.rule != ants[0].rule.getName()) {
+			std::cerr << std::format("Checkpoint was run with rule {}, not {}\n", ants[0].rule.getName(), options.rule);
+			return 1;
+		}
+		Rule::parse(options.rule, ants[0].rule);
+	}
 
-	std::vector<uint8_t> raw(grid.getSize() + 2 * sizeof(int32_t) + sizeof(grid_length) + sizeof(direction) + sizeof(steps));
+	if (!options.ants.empty()) {
+		if (snapshot) {
+			std::cerr << "Ants can only be added to a new run\n";
+			return 1;
+		}
 
-	size_t offset = 0;
+		// Grow the grid until every ant starts inside it.
+		auto inside = [&](int64_t offset) {
+			const int64_t position = int64_t(grid.getOrigin()) + offset;
+			return 0 <= position && position < int64_t(grid.getLength());
+		};
+		for (const auto &option: options.ants)
+			while (!inside(option.x) || !inside(option.y))
+				grid.expand(ants[0].x, ants[0].y);
+
+		for (const auto &option: options.ants) {
+			Ant &ant = ants.emplace_back();
+			ant.x = Coord(grid.getOrigin() + option.x);
+			ant.y = Coord(grid.getOrigin() + option.y);
+			ant.direction = option.direction;
+			ant.rule = ants[0].rule;
+			if (!option.rule.empty())
+				Rule::parse(option.rule, ant.rule);
+		}
+	}
 
-	auto move = [&offset, &raw](const auto &item) {
-		std::memmove(raw.data() + offset, &item, sizeof(item));
-		offset += sizeof(item);
-	};
+	if (1 < ants.size())
+		std::cerr << std::format("Running {} ants.\n", ants.size());
 
-	move(x);
-	move(y);
-	move(grid_length);
-	move(direction);
-	move(steps);
-	std::memmove(raw.data() + offset, grid.getData().data(), grid.getSize());
-	return Zstd::compress(raw);
-}
+	// Cells can take any color of any ant's rule.
+	const Rule &rule = Ant::widestRule(ants);
+	Ant &ant = ants[0];
 
-size_t load(std::span<const uint8_t> compressed, Grid<uint8_t, Coord> &grid, int32_t &x, int32_t &y, uint8_t &direction) {
-	std::vector<uint8_t> raw = Zstd::decompress(compressed);
+	Palette palette = Palette::forRule(rule);
+	if (!options.palette.empty() && !Palette::parse(options.palette, rule, palette)) {
+		std::cerr << std::format("Invalid palette: {}\n", options.palette);
+		return 1;
+	}
 
-	size_t grid_length{};
-	size_t offset = 0;
-	size_t steps{};
+	// A resumed run goes on recording whatever the checkpoint's heatmap has, so that the next checkpoint keeps it.
+	Heatmap::Counter heatmap_counter = options.heatmapCounter;
+	bool heatmap_last_visit = options.heatmapLastVisit;
+	if (snapshot) {
+		if (heatmap_counter == Heatmap::Counter::None)
+			heatmap_counter = snapshot->getHeatmapCounter();
+		heatmap_last_visit = heatmap_last_visit || snapshot->hasLastVisit();
+	}
 
-	auto move = [&offset, &raw](auto &item) {
-		std::memmove(&item, raw.data() + offset, sizeof(item));
-		offset += sizeof(item);
-	};
+	std::unique_ptr<Heatmap> heatmap;
+	if (heatmap_counter != Heatmap::Counter::None || heatmap_last_visit) {
+		if (1 < ants.size()) {
+			std::cerr << "The heatmap only supports a single ant\n";
+			return 1;
+		}
+		heatmap = std::make_unique<Heatmap>(heatmap_counter, heatmap_last_visit, grid.getLength());
+		if (snapshot)
+			snapshot->toHeatmap(*heatmap);
+	}
 
-	move(x);
-	move(y);
-	move(grid_length);
-	move(direction);
-	move(steps);
+	if (options.reverse) {
+		if (!snapshot) {
+			std::cerr << "Reversing needs a checkpoint\n";
+			return 1;
+		}
+		if (previous_steps < steps) {
+			std::cerr << std::format("Checkpoint only has {} step{} to undo\n", previous_steps, previous_steps == 1? "" : "s");
+			return 1;
+		}
+		// Anything else would be saved as the state at the earlier step without being it.
+		if (!isExactlyReversible(ants)) {
+			std::cerr << "Only ants that share a rule other than the default can run in reverse exactly\n";
+			return 1;
+		}
+		if (heatmap || options.timeLapse.every != 0 || options.timeLapse.perDecade != 0 || options.keyframes.isEnabled()) {
+			std::cerr << "The heatmap, time-lapse and keyframes can't run in reverse\n";
+			return 1;
+		}
+	}
 
-	grid = Grid<uint8_t, Coord>(grid_length);
-	std::memmove(grid.getData().data(), raw.data() + offset, grid_length * grid_length);
+	snapshot.reset();
 
-	return steps;
-}
+	std::cerr << std::format("{} {} step{}.\n", options.reverse? "Undoing" : "Processing", steps, steps == 1? "" : "s");
 
-std::unique_ptr<uint8_t[]> makeImage(const Grid<uint8_t, Coord> &grid) {
-	auto pixels = std::make_unique<uint8_t[]>(grid.getSize() * 4);
+	size_t done = 0;
 
-	size_t i = 0;
+	auto saveAndWrite = [&](const std::string &message = "Compressing checkpoint.") {
+		if (checkpoint_path.empty())
+			return;
 
-	auto set_pixel = [&i, &pixels](uint32_t color) {
-		pixels[i++] = color >> 24;
-		pixels[i++] = (color >> 16) & 0xff;
-		pixels[i++] = (color >> 8) & 0xff;
-		pixels[i++] = color & 0xff;
-	};
+		std::cerr << message << '\n';
+		const size_t step = options.reverse? previous_steps - done : previous_steps + done;
+		std::vector<uint8_t> compressed = Checkpoint::save(grid, ants, step, heatmap.get());
+		std::cerr << "Saving checkpoint.\n";
 
-	for (const auto cell: grid) {
-		if (cell == 0) {
-			set_pixel(0xffffffff);
-		} else if (cell == 1) {
-			set_pixel(0xff0000ff);
-		} else if (cell == 2) {
-			set_pixel(0x00ff00ff);
-		} else if (cell == 3) {
-			set_pixel(0x0000ffff);
+		if (Checkpoint::write(checkpoint_path, compressed, options.sync, options.generations)) {
+			std::cerr << std::format("Saved checkpoint to {}\n", checkpoint_path.string());
 		} else {
-			set_pixel(0x000000ff);
+			std::cerr << std::format("Failed to save checkpoint to {}\n", checkpoint_path.string());
 		}
-	}
+	};
 
-	return pixels;
-}
+	// The view depends on the grid's current size and contents, so it is rebuilt for every image.
+	auto makeView = [&] {
+		return options.makeView(grid.getLength(), [&] { return grid.getBounds(); });
+	};
 
-int main(int argc, char **argv) {
-	size_t steps = 1'000;
-	std::filesystem::path checkpoint_path;
+	Scheduler scheduler(std::chrono::seconds(options.checkpointSeconds), options.checkpointSteps);
 
-	if (2 <= argc)
-		steps = parseNumber<size_t>(argv[1]);
+	std::unique_ptr<TimeLapse> time_lapse;
+	if (options.timeLapse.every != 0 || options.timeLapse.perDecade != 0)
+		time_lapse = std::make_unique<TimeLapse>(options.timeLapse, palette, previous_steps);
 
-	if (3 <= argc)
-		checkpoint_path = argv[2];
+	std::unique_ptr<Keyframes::Recorder> keyframes;
+	if (options.keyframes.isEnabled())
+		keyframes = std::make_unique<Keyframes::Recorder>(options.keyframes, options.sync, previous_steps);
 
-	Grid<uint8_t, Coord> grid(1);
-	Coord x = 0;
-	Coord y = 0;
-	uint8_t direction = 0;
-	size_t previous_steps = 0;
+	std::unique_ptr<BlockCache> block_cache;
+	if (options.blockCache != 0 && ants.size() == 1)
+		block_cache = std::make_unique<BlockCache>(options.blockCache);
 
-	if (3 <= argc) {
-		if (std::filesystem::exists(argv[2])) {
-			std::cerr << std::format("Loading steps from {}.\n", argv[2]);
-			std::string compressed = readFile(argv[2]);
-			std::span span(reinterpret_cast<const uint8_t *>(compressed.data()), compressed.size());
-			previous_steps = load(span, grid, x, y, direction);
-			std::cerr << std::format("Loaded {} step{}. Grid length is {}.\n", previous_steps, previous_steps == 1? "" : "s", grid.getLength());
-		} else {
-			std::cerr << std::format("Couldn't find checkpoint {}.\n", argv[2]);
-		}
+	std::unique_ptr<Jit> jit;
+	if (options.jit && ants.size() == 1) {
+		jit = std::make_unique<Jit>(ant.rule);
+		if (jit->isCompiled())
+			std::cerr << std::format("Compiled step loops for {}.\n", ant.rule.getName());
+		else
+			std::cerr << std::format("Couldn't compile a step loop for {}, using the portable one.\n", ant.rule.getName());
 	}
 
-	std::cerr << std::format("Processing {} step{}.\n", steps, steps == 1? "" : "s");
+	std::chrono::duration<double> simulation_time{};
 
-	auto saveAndWrite = [&](const std::string &message = "Compressing checkpoint.") {
-		if (argc < 3)
-			return;
+	while (done < steps) {
+		size_t batch = scheduler.nextBatch(done, steps);
 
-		std::cerr << message << '\n';
-		std::vector<uint8_t> compressed = save(grid, x, y, direction, steps + previous_steps);
-		std::ofstream ofs(checkpoint_path);
-		std::cerr << "Saving checkpoint.\n";
-		ofs.write(reinterpret_cast<const char *>(compressed.data()), compressed.size());
-
-		if (ofs) {
-			std::cerr << std::format("Saved checkpoint to {}\n", checkpoint_path.string());
-		} else {
-			std::cerr << std::format("Failed to save checkpoint to {}\n", checkpoint_path.string());
+		if (time_lapse) {
+			if (time_lapse->getNextStep() == previous_steps + done)
+				time_lapse->capture(grid, previous_steps + done);
+			batch = std::min(batch, time_lapse->getNextStep() - previous_steps - done);
 		}
-	};
 
-	if (steps < 1'000'000'000) {
-		for (size_t i = 0; i < steps; ++i) {
-			auto &color = grid(x, y);
-			direction = (direction + 1 + ((color == 1) << 1)) & 3;
-			color = color + 1 - (color == 3) * 3;
-			applyOffset(direction, x, y);
+		if (keyframes) {
+			if (keyframes->getNextStep() == previous_steps + done)
+				keyframes->capture(grid, ants, previous_steps + done);
+			batch = std::min(batch, keyframes->getNextStep() - previous_steps - done);
 		}
 
-		saveAndWrite();
-	} else {
-		constexpr static size_t CHUNKS = 10;
-		for (size_t chunk = 0; chunk < CHUNKS; ++chunk) {
-			for (size_t i = 0; i < steps / CHUNKS; ++i) {
-				auto &color = grid(x, y);
-				direction = (direction + 1 + ((color == 1) << 1)) & 3;
-				color = color + 1 - (color == 3) * 3;
-				applyOffset(direction, x, y);
+		const auto batch_start = std::chrono::steady_clock::now();
+		if (options.reverse)
+			reverse(grid, ants, batch);
+		else if (heatmap)
+			heatmap->run(grid, ant.x, ant.y, ant.direction, batch, previous_steps + done, ant.rule);
+		else if (block_cache)
+			simulateCached(grid, ant.x, ant.y, ant.direction, batch, ant.rule, *block_cache);
+		else if (jit && jit->isCompiled())
+			simulateJit(grid, ant.x, ant.y, ant.direction, batch, ant.rule, *jit);
+		else if (ants.size() == 1 && options.skipHighways)
+			Highway::advance(grid, ant.x, ant.y, ant.direction, batch, ant.rule);
+		else
+			simulatePartitioned(grid, ants, batch, threadCount());
+		simulation_time += std::chrono::steady_clock::now() - batch_start;
+		done += batch;
+
+		if (done < steps && scheduler.due(done)) {
+			saveAndWrite(std::format("Compressing checkpoint at {:.2f}%.", 100.0 * done / steps));
+			if (const View view = makeView(); !options.snapshotPath.empty() && view.outputWidth() != 0 && view.outputHeight() != 0) {
+				const auto start = std::chrono::steady_clock::now();
+				if (writeImage(options.snapshotPath, grid, palette, view)) {
+					const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+					std::cerr << std::format("Wrote snapshot to {} in {:.3f} s\n", options.snapshotPath.string(), elapsed.count());
+				}
 			}
-
-			saveAndWrite(std::format("Compressing checkpoint at {:.2f}%.", 100.0 * chunk / CHUNKS));
+			scheduler.mark(done);
 		}
 	}
 
-	const auto length = grid.getLength();
-	std::cerr << std::format("Producing raw image from {}x{} grid.\n", length, length);
-	auto pixels = makeImage(grid);
+	if (0 < simulation_time.count()) {
+		std::cerr << std::format("Ran {} step{} in {:.3f} s ({:.2f} million steps per second{}).\n", done, done == 1? "" : "s",
+			simulation_time.count(), done / simulation_time.count() / 1e6, heatmap? ", instrumented" : "");
+	}
+
+	if (block_cache)
+		std::cerr << std::format("Block cache: {} hits, {} misses.\n", block_cache->getHits(), block_cache->getMisses());
+
+	if (time_lapse) {
+		if (time_lapse->getNextStep() == previous_steps + done)
+			time_lapse->capture(grid, previous_steps + done);
+		if (!time_lapse->finish())
+			std::cerr << "Failed to write some time-lapse frames.\n";
+	}
+
+	if (keyframes && keyframes->getNextStep() == previous_steps + done)
+		keyframes->capture(grid, ants, previous_steps + done);
 
-	std::filesystem::path path{"langton.png"};
+	saveAndWrite();
 
-	std::cerr << std::format("Writing {}x{} image ({:.2f} MiB) to {}\n", length, length, length * length * 4 / (1024. * 1024.), path.string());
+	std::cerr << std::format("State fingerprint: {:016x}\n", Hash::fingerprint(grid, ants));
 
-	std::vector<unsigned char> png;
-	std::cerr << "Compressing PNG.\n";
-	unsigned error = lodepng::encode(png, pixels.get(), length, length);
+	if (heatmap) {
+		std::cerr << std::format("Writing heatmap to {}\n", options.heatmapPath.string());
+		if (!heatmap->writeImage(options.heatmapPath, previous_steps + done))
+			std::cerr << std::format("Failed to write heatmap to {}\n", options.heatmapPath.string());
+	}
+
+	const auto length = grid.getLength();
 
-	if (error) {
-		std::cerr << std::format("Failed to compress and write to {}: {}\n", path.string(), error);
+	if (!options.pyramidPath.empty()) {
+		std::cerr << std::format("Writing tile pyramid of {}x{} grid to {}.dzi\n", length, length, options.pyramidPath.string());
+		if (!writePyramid(options.pyramidPath, grid, palette)) {
+			std::cerr << std::format("Failed to write tile pyramid to {}\n", options.pyramidPath.string());
+			return 1;
+		}
+		std::cerr << std::format("Successfully wrote tile pyramid to {}.dzi\n", options.pyramidPath.string());
+		return 0;
+	}
+
+	const View view = makeView();
+
+	if (view.outputWidth() == 0 || view.outputHeight() == 0) {
+		std::cerr << "Nothing to render.\n";
 		return 1;
 	}
 
-	std::cerr << "Writing PNG.\n";
-	error = lodepng::save_file(png, path);
-	if (error) {
-		std::cerr << std::format("Failed to write to {}: {}\n", path.string(), error);
+	const std::filesystem::path &path = options.outputPath;
+
+	ImageFormat format = ImageFormat::PNG;
+	parseImageFormat(path, format);
+
+	if (format != ImageFormat::PNG) {
+		std::cerr << std::format("Writing {}x{} image to {}\n", view.outputWidth(), view.outputHeight(), path.string());
+	} else if (view.isPalette()) {
+		std::cerr << std::format("Writing {}x{} image at {} bit{} per pixel to {}\n", view.outputWidth(), view.outputHeight(),
+			palette.bitDepth(), palette.bitDepth() == 1? "" : "s", path.string());
+	} else {
+		std::cerr << std::format("Writing {}x{} RGBA image to {}\n", view.outputWidth(), view.outputHeight(), path.string());
+	}
+
+	if (!writeImage(path, grid, palette, view)) {
+		std::cerr << std::format("Failed to write to {}\n", path.string());
 		return 1;
 	}
 
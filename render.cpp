@@ -0,0 +1,89 @@
+#include "Ant.h"
+#include "Checkpoint.h"
+#include "Grid.h"
+#include "Image.h"
+#include "Options.h"
+#include "Pyramid.h"
+#include "Rule.h"
+#include "Types.h"
+#include "Util.h"
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <iostream>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+int main(int argc, char **argv) {
+	const Options options = parseRenderOptions(argc, argv);
+	const std::filesystem::path &checkpoint_path = options.checkpointPath;
+
+	if (!std::filesystem::exists(checkpoint_path)) {
+		std::cerr << std::format("Couldn't find checkpoint {}.\n", checkpoint_path.string());
+		return 1;
+	}
+
+	const auto start = std::chrono::steady_clock::now();
+
+	std::cerr << std::format("Loading {}.\n", checkpoint_path.string());
+	// The compressed file is released as soon as it has been decompressed.
+	auto compressed = std::make_unique<std::string>(readFile(checkpoint_path));
+	const Checkpoint::Snapshot snapshot(std::span(reinterpret_cast<const uint8_t *>(compressed->data()), compressed->size()));
+	compressed.reset();
+
+	const size_t length = snapshot.getLength();
+	std::cerr << std::format("Loaded {} step{}. Grid length is {}.\n", snapshot.getSteps(), snapshot.getSteps() == 1? "" : "s", length);
+
+	std::vector<Ant> ants;
+	if (!snapshot.getAnts(ants)) {
+		std::cerr << "Checkpoint has an ant with an invalid rule\n";
+		return 1;
+	}
+	const Rule &rule = Ant::widestRule(ants);
+
+	Palette palette = Palette::forRule(rule);
+	if (!options.palette.empty() && !Palette::parse(options.palette, rule, palette)) {
+		std::cerr << std::format("Invalid palette: {}\n", options.palette);
+		return 1;
+	}
+
+	if (!options.pyramidPath.empty()) {
+		// Every level of the pyramid is derived from the one below it, so the grid has to be expanded in full.
+		Grid<uint8_t, Coord> grid(0);
+		snapshot.toGrid(grid);
+		std::cerr << std::format("Writing tile pyramid of {}x{} grid to {}.dzi\n", length, length, options.pyramidPath.string());
+		if (!writePyramid(options.pyramidPath, grid, palette)) {
+			std::cerr << std::format("Failed to write tile pyramid to {}\n", options.pyramidPath.string());
+			return 1;
+		}
+		std::cerr << std::format("Successfully wrote tile pyramid to {}.dzi\n", options.pyramidPath.string());
+		return 0;
+	}
+
+	const View view = options.makeView(length, [&] { return snapshot.getBounds(); });
+
+	if (view.outputWidth() == 0 || view.outputHeight() == 0) {
+		std::cerr << "Nothing to render.\n";
+		return 1;
+	}
+
+	const std::filesystem::path &path = options.outputPath;
+	std::cerr << std::format("Writing {}x{} image to {}\n", view.outputWidth(), view.outputHeight(), path.string());
+
+	// Rows are unpacked straight from the checkpoint's tiles, so the full grid never has to exist in memory.
+	auto read_cells = [&](size_t row, size_t column, size_t count, uint8_t *out) {
+		snapshot.readCells(row, column, count, out);
+	};
+
+	if (!writeImage(path, length, read_cells, palette, view)) {
+		std::cerr << std::format("Failed to write to {}\n", path.string());
+		return 1;
+	}
+
+	const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	std::cerr << std::format("Successfully wrote to {} in {:.3f} s\n", path.string(), elapsed.count());
+}